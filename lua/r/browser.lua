@@ -12,6 +12,9 @@ local curview = "GlobalEnv"
 local ob_win
 local ob_buf
 local upobcnt = false
+local ob_version -- Version of the rendering shown in the Object Browser
+local ob_resync = false -- Was the whole view requested after a missed update?
+local ob_view = "" -- Lines in view last sent to rnvimserver
 local running_objbr = false
 local auto_starting = true
 
@@ -152,6 +155,13 @@ local set_buf_options = function()
         pattern = "<buffer>",
     })
 
+    -- The pattern of WinScrolled is the window ID
+    vim.api.nvim_create_autocmd("WinScrolled", {
+        group = vim.api.nvim_create_augroup("RBrowserView", { clear = true }),
+        pattern = tostring(vim.api.nvim_get_current_win()),
+        callback = function() require("r.browser").send_view() end,
+    })
+
     vim.api.nvim_buf_set_lines(0, 0, 1, false, { ".GlobalEnv | Libraries" })
 
     require("r.config").real_setup()
@@ -169,7 +179,8 @@ find_parent = function(child, curline, curpos)
         line = vim.api.nvim_buf_get_lines(0, curline - 1, curline, true)[1]
         line = line:gsub("\t.*", "")
         idx = line:find("#")
-        if idx < curpos then
+        -- Lines out of view are empty
+        if idx and idx < curpos then
             parent = line:sub(idx + 1)
             if line:find("%[#") or line:find("%$#") then
                 suffix = "$"
@@ -292,6 +303,7 @@ M.start = function(_)
     send_to_nvimcom("A", "RObjBrowser")
 
     start_OB()
+    M.send_view()
     running_objbr = false
 
     if config.hook.after_ob_open then config.hook.after_ob_open() end
@@ -299,6 +311,19 @@ end
 
 M.get_curview = function() return curview end
 
+--- Tells rnvimserver which lines of the current view of the Object Browser
+--- are in view. Only they are rendered, with a margin.
+M.send_view = function()
+    if not ob_win or not vim.api.nvim_win_is_valid(ob_win) then return end
+    local view = (curview == "GlobalEnv" and "G" or "L")
+        .. (vim.fn.line("w0", ob_win) - 1)
+        .. " "
+        .. vim.fn.line("w$", ob_win)
+    if view == ob_view then return end
+    ob_view = view
+    job.stdin("Server", "35" .. view .. "\n")
+end
+
 M.get_pkg_name = function()
     local lnum = vim.api.nvim_win_get_cursor(0)[1]
     while lnum > 0 do
@@ -357,33 +382,42 @@ end
 
 M.open_close_lists = function(stt) job.stdin("Server", "34" .. stt .. curview .. "\n") end
 
-M.update_OB = function(what)
-    local wht = what == "both" and curview or what
-    if curview ~= wht then return "curview != what" end
+--- Patches the Object Browser with the lines that changed in a view.
+---@param what string The view: "GlobalEnv" or "libraries".
+---@param base number Version of the rendering the hunks apply to, or 0 if
+---the single hunk replaces the whole buffer.
+---@param version number Version of the new rendering.
+---@param hunks table List of {start, end, number of lines, lines separated
+---by "\006"}, with the lines numbered from 0 and end excluded.
+M.update_OB = function(what, base, version, hunks)
+    if curview ~= what then return "curview != what" end
     if upobcnt then
         -- vim.api.nvim_err_writeln("OB called twice")
         return "OB called twice"
     end
 
-    upobcnt = true
-
-    if not ob_buf then
-        upobcnt = false
-        return "Object_Browser not listed"
-    end
+    if not ob_buf then return "Object_Browser not listed" end
 
-    local lines
-    if wht == "GlobalEnv" then
-        lines = vim.fn.readfile(config.localtmpdir .. "/globenv_" .. vim.env.RNVIM_ID)
-    else
-        lines = vim.fn.readfile(config.localtmpdir .. "/liblist_" .. vim.env.RNVIM_ID)
+    if base ~= 0 and base ~= ob_version then
+        -- An update was missed: ask rnvimserver for the whole view
+        if not ob_resync then
+            ob_resync = true
+            job.stdin("Server", what == "GlobalEnv" and "31\n" or "32\n")
+        end
+        return "missed update"
     end
-    if not lines then lines = { "Error loading data" } end
 
+    upobcnt = true
     vim.api.nvim_set_option_value("modifiable", true, { buf = ob_buf })
-    vim.api.nvim_buf_set_lines(ob_buf, 0, -1, false, lines)
-
+    -- Patch from the end to keep the line numbers of the previous hunks valid
+    for i = #hunks, 1, -1 do
+        local h = hunks[i]
+        local lines = h[3] == 0 and {} or vim.split(h[4], "\006", { plain = true })
+        vim.api.nvim_buf_set_lines(ob_buf, h[1], h[2], false, lines)
+    end
     vim.api.nvim_set_option_value("modifiable", false, { buf = ob_buf })
+    ob_version = version
+    if base == 0 then ob_resync = false end
     upobcnt = false
 end
 
@@ -393,11 +427,16 @@ M.on_double_click = function()
 
     -- Toggle view: Objects in the workspace X List of libraries
     if lnum == 1 then
+        ob_version = nil
+        ob_resync = false
+        -- The lines in view are sent first to render the new view only once
         if curview == "libraries" then
             curview = "GlobalEnv"
+            M.send_view()
             job.stdin("Server", "31\n")
         else
             curview = "libraries"
+            M.send_view()
             job.stdin("Server", "321\n")
         end
         return
@@ -503,7 +542,11 @@ end
 
 M.on_BufUnload = function()
     ob_buf = nil
+    ob_version = nil
+    ob_resync = false
+    ob_view = ""
     ob_win = nil
+    vim.api.nvim_create_augroup("RBrowserView", { clear = true })
     send_to_nvimcom("N", "OnOBBufUnload")
 end
 
@@ -20,6 +20,8 @@ local config = {
     auto_start          = "no",
     bracketed_paste     = false,
     buffer_opts         = "winfixwidth winfixheight nobuflisted",
+    build_helper        = false,
+    build_workers       = 0,
     clear_console       = true,
     clear_line          = false,
     close_term          = true,
@@ -44,6 +46,7 @@ local config = {
     latexcmd            = { "default" },
     listmethods         = false,
     local_R_library_dir = "",
+    max_compl_items     = 0,
     max_paste_lines     = 20,
     min_editor_width    = 80,
     non_r_compl         = true,
@@ -281,6 +284,10 @@ local do_common_global = function()
             flist,
             vim.fn.split(vim.fn.glob(config.compldir .. "/args_*"), "\n")
         )
+        flist = vim.fn.extend(
+            flist,
+            vim.fn.split(vim.fn.glob(config.compldir .. "/compl_*"), "\n")
+        )
 
         if #flist > 0 then
             for _, f in ipairs(flist) do
@@ -295,14 +302,16 @@ local do_common_global = function()
             "The omnils_ and args_ are used for omni completion, the fun_ files for ",
             "syntax highlighting, and the inst_libs for library description in the ",
             "Object Browser. If you delete them, they will be regenerated.",
+            "The compl_ files are binary copies of the omnils_ files built by the",
+            "rnvimserver to load them faster.",
             "",
             "When you load a new version of a library, their files are replaced.",
             "",
             "Files corresponding to uninstalled libraries are not automatically deleted.",
             "You should manually delete them if you want to save disk space.",
             "",
-            "If you delete this README file, all omnils_, args_ and fun_ files will be ",
-            "regenerated.",
+            "If you delete this README file, all omnils_, args_, fun_ and compl_ files",
+            "will be regenerated.",
             "",
             "All lines in the omnils_ files have 7 fields with information on the object",
             "separated by the byte \\006:",
@@ -139,8 +139,10 @@ M.start_extern_term = function()
         .. vim.env.RNVIM_ID
         .. " RNVIM_SECRET="
         .. vim.env.RNVIM_SECRET
-        .. " RNVIM_PORT="
-        .. vim.env.RNVIM_PORT
+        .. (
+            vim.env.RNVIM_SOCKET and (" RNVIM_SOCKET=" .. vim.env.RNVIM_SOCKET:gsub(" ", "\\ "))
+            or (" RNVIM_PORT=" .. vim.env.RNVIM_PORT)
+        )
         .. " R_DEFAULT_PACKAGES="
         .. vim.env.R_DEFAULT_PACKAGES
         .. " "
@@ -26,12 +26,6 @@ start_R2 = function()
         end)
     end
 
-    vim.fn.writefile({}, config.localtmpdir .. "/globenv_" .. vim.env.RNVIM_ID)
-    vim.fn.writefile({}, config.localtmpdir .. "/liblist_" .. vim.env.RNVIM_ID)
-
-    edit.add_for_deletion(config.localtmpdir .. "/globenv_" .. vim.env.RNVIM_ID)
-    edit.add_for_deletion(config.localtmpdir .. "/liblist_" .. vim.env.RNVIM_ID)
-
     if vim.o.encoding == "utf-8" then
         edit.add_for_deletion(config.tmpdir .. "/start_options_utf8.R")
     else
@@ -163,6 +157,15 @@ end
 M.set_nrs_port = function(p)
     vim.g.R_Nvim_status = 5
     vim.env.RNVIM_PORT = p
+    vim.env.RNVIM_SOCKET = nil
+end
+
+--- Called by rnvimserver when it is listening on a Unix domain socket.
+---@param s string Path to the socket.
+M.set_nrs_socket = function(s)
+    vim.g.R_Nvim_status = 5
+    vim.env.RNVIM_SOCKET = s
+    vim.env.RNVIM_PORT = nil
 end
 
 M.start_R = function(whatr)
@@ -310,8 +313,6 @@ M.set_nvimcom_info = function(nvimcomversion, rpid, wid, r_info)
 end
 
 M.clear_R_info = function()
-    vim.fn.delete(config.tmpdir .. "/globenv_" .. vim.fn.string(vim.env.RNVIM_ID))
-    vim.fn.delete(config.localtmpdir .. "/liblist_" .. vim.fn.string(vim.env.RNVIM_ID))
     R_pid = 0
     if type(config.external_term) == "boolean" and config.external_term == false then
         require("r.term").close_term()
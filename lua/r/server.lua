@@ -152,7 +152,19 @@ local start_rnvimserver = function()
     if config.objbr_opendf then nrs_env["RNVIM_OPENDF"] = "TRUE" end
     if config.objbr_openlist then nrs_env["RNVIM_OPENLS"] = "TRUE" end
     if config.objbr_allnames then nrs_env["RNVIM_OBJBR_ALLNAMES"] = "TRUE" end
+    if config.max_compl_items > 0 then
+        nrs_env["RNVIM_MAX_COMPL"] = tostring(config.max_compl_items)
+    end
+    if config.build_workers > 0 then
+        nrs_env["RNVIM_BUILD_WORKERS"] = tostring(config.build_workers)
+    end
+    if config.build_helper then nrs_env["RNVIM_BUILD_HELPER"] = "TRUE" end
     nrs_env["RNVIM_RPATH"] = config.R_cmd
+    -- nvimcom connects through a Unix domain socket when R runs on the same
+    -- machine. TCP is still required to communicate with a remote R.
+    if config.remote_compldir == "" and not config.is_windows then
+        nrs_env["RNVIM_UNIX_SOCKET"] = "TRUE"
+    end
     nrs_env["RNVIM_LOCAL_TMPDIR"] = config.localtmpdir
 
     -- We have to set R's home directory on Windows because rnvimserver will
@@ -290,20 +302,35 @@ build_all_args = function(_)
         flist[i] = afile:gsub("/omnils_", "/args_")
     end
 
-    local rscrpt = { 'library("nvimcom", warn.conflicts = FALSE)' }
+    local alist = {}
     for _, afile in ipairs(flist) do
         if vim.fn.filereadable(afile) == 0 then
             local pkg = afile:gsub(".*/args_", ""):gsub("_.*", "")
-            table.insert(
-                rscrpt,
-                'nvimcom:::nvim.buildargs("' .. afile .. '", "' .. pkg .. '")'
-            )
+            table.insert(alist, { afile, pkg })
         end
     end
 
-    if #rscrpt == 1 then return end
+    if #alist == 0 then return end
 
     vim.fn.writefile({ "" }, config.compldir .. "/args_lock")
+
+    -- rnvimserver schedules the building of the files and deletes args_lock
+    if not config.is_windows then
+        local req = {}
+        for _, a in ipairs(alist) do
+            table.insert(req, a[1] .. "\t" .. a[2])
+        end
+        job.stdin("Server", "44" .. table.concat(req, "\002") .. "\n")
+        return
+    end
+
+    local rscrpt = { 'library("nvimcom", warn.conflicts = FALSE)' }
+    for _, a in ipairs(alist) do
+        table.insert(
+            rscrpt,
+            'nvimcom:::nvim.buildargs("' .. a[1] .. '", "' .. a[2] .. '")'
+        )
+    end
     table.insert(rscrpt, 'unlink("' .. config.compldir .. '/args_lock")')
 
     local scrptnm = config.tmpdir .. "/build_args.R"
@@ -320,6 +347,35 @@ build_all_args = function(_)
     )
 end
 
+-- Send to rnvimserver the packages referenced in the buffers being edited,
+-- whose lists for completion are built first.
+M.send_buf_libs = function()
+    local libs = {}
+    local seen = {}
+    local add = function(lib)
+        if lib and not seen[lib] then
+            seen[lib] = true
+            table.insert(libs, lib)
+        end
+    end
+    for _, b in ipairs(vim.api.nvim_list_bufs()) do
+        local ft = vim.bo[b].filetype
+        if
+            vim.api.nvim_buf_is_loaded(b)
+            and (ft == "r" or ft == "rmd" or ft == "quarto" or ft == "rnoweb")
+        then
+            for _, v in ipairs(vim.api.nvim_buf_get_lines(b, 0, -1, false)) do
+                add(v:match("library%s*%(%s*[\"']?([%w%.]+)"))
+                add(v:match("require%s*%(%s*[\"']?([%w%.]+)"))
+                for lib in v:gmatch("([%w%.]+):::?") do
+                    add(lib)
+                end
+            end
+        end
+    end
+    job.stdin("Server", "45" .. table.concat(libs, "\002") .. "\n")
+end
+
 -- Add words to the completion list of :Rhelp
 local add_to_Rhelp_list = function(lib)
     local omf = config.compldir .. "/omnils_" .. lib
@@ -0,0 +1,163 @@
+#include "compldb.h"
+#include "logging.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char compldb_magic[8] = {'R', 'N', 'V', 'C', 'D', 'B', '\r', '\n'};
+
+static size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+/**
+ * @brief Returns the size of the arrays of n records, as allocated by
+ * index_omnils() and stored in compl_ files.
+ */
+size_t compldb_arrays_size(int n) {
+    return align8((size_t)n * (sizeof(uint64_t) + 9 * sizeof(uint32_t) +
+                               sizeof(uint16_t) + 1));
+}
+
+/**
+ * @brief Points the arrays of the records to their positions in a block of
+ * compldb_arrays_size(n) bytes aligned to 8. The widest elements come first
+ * to keep each array aligned.
+ */
+void compldb_set_arrays(OmnilsRecs *r, char *a, int n) {
+    r->cmask = (uint64_t *)a;
+    a += n * sizeof(uint64_t);
+    r->name = (uint32_t *)a;
+    a += n * sizeof(uint32_t);
+    r->fld = (uint32_t *)a;
+    a += 7 * n * sizeof(uint32_t);
+    r->nsep = (uint32_t *)a;
+    a += n * sizeof(uint32_t);
+    r->nlen = (uint16_t *)a;
+    a += n * sizeof(uint16_t);
+    r->type = a;
+}
+
+// FNV-1a hash of the header fields before the checksum
+static uint32_t header_sum(const ComplDbHeader *h) {
+    const unsigned char *s = (const unsigned char *)h;
+    uint32_t sum = 2166136261u;
+    for (size_t i = 0; i < offsetof(ComplDbHeader, sum); i++) {
+        sum ^= s[i];
+        sum *= 16777619u;
+    }
+    return sum;
+}
+
+/**
+ * @brief Checks that the offsets of the records of a compl_ file are within
+ * the string table, so that a corrupted file is never read out of its
+ * mapping. The name must come before the fields, which must be in order. The
+ * string table itself is not read.
+ */
+static int records_ok(const OmnilsRecs *r, uint64_t text_size) {
+    for (int k = 0; k < r->n; k++) {
+        const uint32_t *f = r->fld + 7 * k;
+        if ((uint64_t)r->name[k] + r->nlen[k] >= f[0] || f[6] > text_size)
+            return 0;
+        for (int i = 1; i < 7; i++)
+            if (f[i] <= f[i - 1])
+                return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Uses a compl_ file mapped into memory as the records of a package.
+ *
+ * The header and the offsets of the records are checked, but the string
+ * table is used as is.
+ *
+ * @param b The mapped file.
+ * @param sz Size of the file.
+ * @param src_size Size of the omnils_ file.
+ * @param src_mtime Modification time of the omnils_ file.
+ * @param r The records to be set.
+ * @return 1 on success or 0 if the file is not valid or outdated.
+ */
+int compldb_open(const char *b, size_t sz, uint64_t src_size,
+                 int64_t src_mtime, OmnilsRecs *r) {
+    ComplDbHeader h;
+    if (sz < sizeof(h))
+        return 0;
+    memcpy(&h, b, sizeof(h));
+    if (memcmp(h.magic, compldb_magic, sizeof(h.magic)) != 0 ||
+        h.version != COMPLDB_VERSION || h.byteorder != 0x01020304 ||
+        h.sum != header_sum(&h) || h.src_size != src_size ||
+        h.src_mtime != src_mtime)
+        return 0;
+    size_t asz = compldb_arrays_size(h.n);
+    if (sz != sizeof(h) + asz + h.text_size + 1 || b[sz - 1] != 0)
+        return 0;
+
+    memset(r, 0, sizeof(OmnilsRecs));
+    compldb_set_arrays(r, (char *)b + sizeof(h), h.n);
+    r->buf = b + sizeof(h) + asz;
+    r->nbuf = r->buf;
+    r->n = h.n;
+    if (!records_ok(r, h.text_size)) {
+        Log("compldb_open: invalid records");
+        memset(r, 0, sizeof(OmnilsRecs));
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Writes the compl_ file of a package.
+ *
+ * The file is written under a temporary name and then renamed, so that other
+ * rnvimserver instances never map an incomplete file.
+ *
+ * @param fname Name of the compl_ file.
+ * @param src_size Size of the omnils_ file.
+ * @param src_mtime Modification time of the omnils_ file.
+ * @param r Records built by index_omnils() from the converted omnils_ file.
+ * @param text_size Size of the converted omnils_ file.
+ * @return 1 on success or 0 on failure.
+ */
+int compldb_write(const char *fname, uint64_t src_size, int64_t src_mtime,
+                  const OmnilsRecs *r, size_t text_size) {
+    if (r->raw || (r->n && !r->arrays))
+        return 0;
+
+    ComplDbHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, compldb_magic, sizeof(h.magic));
+    h.version = COMPLDB_VERSION;
+    h.byteorder = 0x01020304;
+    h.src_size = src_size;
+    h.src_mtime = src_mtime;
+    h.text_size = text_size;
+    h.n = r->n;
+    h.sum = header_sum(&h);
+
+    char tmp[1040];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", fname, (long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        Log("compldb_write: could not open '%s'", tmp);
+        return 0;
+    }
+    size_t asz = compldb_arrays_size(r->n);
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             (asz == 0 || fwrite(r->arrays, asz, 1, f) == 1) &&
+             (text_size == 0 || fwrite(r->buf, text_size, 1, f) == 1) &&
+             fputc(0, f) != EOF;
+    if (fclose(f) != 0)
+        ok = 0;
+#ifdef WIN32
+    if (ok)
+        remove(fname);
+#endif
+    if (!ok || rename(tmp, fname) != 0) {
+        Log("compldb_write: could not write '%s'", fname);
+        remove(tmp);
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,48 @@
+#ifndef COMPLDB_H
+#define COMPLDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "data_structures.h"
+
+// compl_<pkg>_<version> files are a binary copy of the omnils_ file of the
+// same package and version, built by rnvimserver after it reads the omnils_
+// file for the first time. They can be mapped into memory and used without
+// any parsing. The file has:
+//
+//   - A ComplDbHeader.
+//
+//   - The arrays of OmnilsRecs, with the records already sorted by name, in
+//     the layout of compldb_set_arrays().
+//
+//   - The string table: the lines of the omnils_ file converted as by
+//     check_omils_buffer(), followed by a NULL byte. The offsets in the arrays
+//     refer to it.
+//
+// The file is replaced whenever its version, the byte order or the size and
+// modification time of the omnils_ file do not match the header, or if the
+// offsets of any record fall outside the string table.
+
+#define COMPLDB_VERSION 1
+
+typedef struct compldb_header_ {
+    char magic[8];      // "RNVCDB\r\n"
+    uint32_t version;   // COMPLDB_VERSION
+    uint32_t byteorder; // 0x01020304 as written by the machine
+    uint64_t src_size;  // Size of the omnils_ file
+    int64_t src_mtime;  // Modification time of the omnils_ file
+    uint64_t text_size; // Size of the string table, without the NULL byte
+    uint32_t n;         // Number of records
+    uint32_t sum;       // Checksum of the previous fields
+    uint8_t reserved[16];
+} ComplDbHeader;
+
+size_t compldb_arrays_size(int n);
+void compldb_set_arrays(OmnilsRecs *r, char *a, int n);
+int compldb_open(const char *b, size_t sz, uint64_t src_size,
+                 int64_t src_mtime, OmnilsRecs *r);
+int compldb_write(const char *fname, uint64_t src_size, int64_t src_mtime,
+                  const OmnilsRecs *r, size_t text_size);
+
+#endif // COMPLDB_H
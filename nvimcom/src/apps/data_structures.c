@@ -3,39 +3,150 @@
 #include <stdlib.h>
 #include <string.h>
 
-ListStatus *search(ListStatus *root, const char *s) {
-    ListStatus *node = root;
-    int cmp = strcmp(node->key, s);
-    while (node && cmp != 0) {
-        if (cmp > 0)
-            node = node->right;
-        else
-            node = node->left;
-        if (node)
-            cmp = strcmp(node->key, s);
-    }
-    if (cmp == 0)
-        return node;
-    else
-        return NULL;
-}
-
-ListStatus *new_ListStatus(const char *s, int stt) {
-    ListStatus *p;
-    p = calloc(1, sizeof(ListStatus));
-    p->key = malloc((strlen(s) + 1) * sizeof(char));
-    strcpy(p->key, s);
-    p->status = stt;
-    return p;
-}
-
-ListStatus *insert(ListStatus *root, const char *s, int stt) {
-    if (!root)
-        return new_ListStatus(s, stt);
-    int cmp = strcmp(root->key, s);
-    if (cmp > 0)
-        root->right = insert(root->right, s, stt);
-    else
-        root->left = insert(root->left, s, stt);
-    return root;
+static unsigned int name_hash(const char *s) {
+    unsigned int h = 2166136261u;
+    while (*s && *s != '\006' && *s != '\n') {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int end_of_name(char c) { return c == 0 || c == '\006' || c == '\n'; }
+
+// Compares the name at the beginning of a line with a NULL terminated name
+static int name_cmp(const char *line, const char *name) {
+    while (*name && *line == *name) {
+        line++;
+        name++;
+    }
+    return !(*name == 0 && end_of_name(*line));
+}
+
+// Compares the names at the beginning of two lines
+static int key_cmp(const char *a, const char *b) {
+    while (!end_of_name(*a) && *a == *b) {
+        a++;
+        b++;
+    }
+    return !(end_of_name(*a) && end_of_name(*b));
+}
+
+// If there are repeated names, the first one in off is kept
+NameHash *new_NameHash(const char *base, const uint32_t *off, int n) {
+    NameHash *h = malloc(sizeof(NameHash));
+    h->base = base;
+    h->off = off;
+    h->size = 16;
+    while (h->size < 2 * (unsigned int)n)
+        h->size *= 2;
+    h->slots = malloc(h->size * sizeof(int));
+    for (unsigned int i = 0; i < h->size; i++)
+        h->slots[i] = -1;
+    for (int k = 0; k < n; k++) {
+        const char *key = base + off[k];
+        unsigned int i = name_hash(key) & (h->size - 1);
+        while (h->slots[i] != -1 && key_cmp(base + off[h->slots[i]], key) != 0)
+            i = (i + 1) & (h->size - 1);
+        if (h->slots[i] == -1)
+            h->slots[i] = k;
+    }
+    return h;
+}
+
+int name_hash_get(const NameHash *h, const char *name) {
+    if (!h)
+        return -1;
+    unsigned int i = name_hash(name) & (h->size - 1);
+    while (h->slots[i] != -1) {
+        if (name_cmp(h->base + h->off[h->slots[i]], name) == 0)
+            return h->slots[i];
+        i = (i + 1) & (h->size - 1);
+    }
+    return -1;
+}
+
+void free_NameHash(NameHash *h) {
+    if (!h)
+        return;
+    free(h->slots);
+    free(h);
+}
+
+#define LS_BLOCK 1024         // Entries in each block of the pool
+#define LS_ARENA_BLOCK 65536 // Bytes in each block of the key arena
+
+ListStatusTable *new_ListStatusTable(void) {
+    ListStatusTable *t = calloc(1, sizeof(ListStatusTable));
+    t->size = 1024;
+    t->slots = calloc(t->size, sizeof(ListStatus *));
+    return t;
+}
+
+ListStatus *list_status_get(const ListStatusTable *t, const char *s) {
+    uint32_t h = name_hash(s);
+    unsigned int i = h & (t->size - 1);
+    while (t->slots[i]) {
+        if (t->slots[i]->hash == h && strcmp(t->slots[i]->key, s) == 0)
+            return t->slots[i];
+        i = (i + 1) & (t->size - 1);
+    }
+    return NULL;
+}
+
+ListStatus *list_status_at(const ListStatusTable *t, unsigned int i) {
+    return t->pool[i / LS_BLOCK] + i % LS_BLOCK;
+}
+
+// Copies a key into the arena. The blocks are never freed.
+static const char *arena_copy(ListStatusTable *t, const char *s) {
+    size_t len = strlen(s) + 1;
+    if (len > t->arena_left) {
+        size_t sz = len > LS_ARENA_BLOCK ? len : LS_ARENA_BLOCK;
+        t->arena = malloc(sz);
+        t->arena_left = sz;
+    }
+    char *k = t->arena;
+    memcpy(k, s, len);
+    t->arena += len;
+    t->arena_left -= len;
+    return k;
+}
+
+static void grow_slots(ListStatusTable *t) {
+    unsigned int size = 2 * t->size;
+    ListStatus **slots = calloc(size, sizeof(ListStatus *));
+    for (unsigned int k = 0; k < t->n; k++) {
+        ListStatus *e = list_status_at(t, k);
+        unsigned int i = e->hash & (size - 1);
+        while (slots[i])
+            i = (i + 1) & (size - 1);
+        slots[i] = e;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->size = size;
+}
+
+/**
+ * @brief Adds a key to the table, which must not have it yet.
+ * @return The new entry.
+ */
+ListStatus *list_status_add(ListStatusTable *t, const char *s, int stt) {
+    if (4 * (t->n + 1) > 3 * t->size)
+        grow_slots(t);
+    if (t->n == t->npool * LS_BLOCK) {
+        t->pool = realloc(t->pool, (t->npool + 1) * sizeof(ListStatus *));
+        t->pool[t->npool++] = malloc(LS_BLOCK * sizeof(ListStatus));
+    }
+    ListStatus *e = list_status_at(t, t->n++);
+    e->key = arena_copy(t, s);
+    e->hash = name_hash(s);
+    e->status = stt;
+    e->user = 0;
+    unsigned int i = e->hash & (t->size - 1);
+    while (t->slots[i])
+        i = (i + 1) & (t->size - 1);
+    t->slots[i] = e;
+    return e;
 }
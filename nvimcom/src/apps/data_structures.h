@@ -1,6 +1,9 @@
 #ifndef DATA_STRUCTURES_H
 #define DATA_STRUCTURES_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 // Structure for paths to libraries
 typedef struct libpaths_ {
     char *path;             // Path to library
@@ -16,18 +19,77 @@ typedef struct instlibs_ {
     struct instlibs_ *next; // Next installed library
 } InstLibs;
 
-// Structure for list or library open/close status in the Object Browser
+// Open/closed status of a list or library in the Object Browser
 typedef struct liststatus_ {
-    char *key; // Name of the object or library. Library names are prefixed with
-               // "package:"
-    int status;                // 0: closed; 1: open
-    struct liststatus_ *left;  // Left node
-    struct liststatus_ *right; // Right node
+    const char *key; // Name of the object or library. Library names end with
+                     // ':'
+    uint32_t hash;   // Hash of the key
+    int status;      // 0: closed; 1: open
+    int user;        // Was the status set by the user? Otherwise, it is the
+                     // default one
 } ListStatus;
 
-ListStatus *new_ListStatus(const char *s, int stt);
-ListStatus *insert(ListStatus *root, const char *s, int stt);
-ListStatus *search(ListStatus *root, const char *s);
+// Hash table of ListStatus by key. The entries are allocated from a pool of
+// blocks, so that they do not move when the table grows, and the keys are
+// copied into an arena of larger blocks.
+typedef struct list_status_table_ {
+    ListStatus **slots;  // Entries or NULL for empty slots
+    unsigned int size;   // Number of slots (a power of 2)
+    unsigned int n;      // Number of entries
+    ListStatus **pool;   // Blocks of entries, in the order of insertion
+    unsigned int npool;  // Number of blocks in pool
+    char *arena;         // Current block of the key arena
+    size_t arena_left;   // Free bytes in the current block
+} ListStatusTable;
+
+ListStatusTable *new_ListStatusTable(void);
+ListStatus *list_status_get(const ListStatusTable *t, const char *s);
+ListStatus *list_status_add(ListStatusTable *t, const char *s, int stt);
+ListStatus *list_status_at(const ListStatusTable *t, unsigned int i);
+
+// Hash table from names to positions in an array of lines whose first field
+// is a name terminated by a NULL byte, '\006' or a newline (omnils_ and args_
+// files). The lines are given by their offsets in a buffer and are not copied.
+typedef struct name_hash_ {
+    const char *base;    // The buffer with the lines
+    const uint32_t *off; // Offsets of the lines in base
+    int *slots;          // Positions in off or -1 for empty slots
+    unsigned int size;   // Number of slots (a power of 2)
+} NameHash;
+
+NameHash *new_NameHash(const char *base, const uint32_t *off, int n);
+int name_hash_get(const NameHash *h, const char *name);
+void free_NameHash(NameHash *h);
+
+// Fields of the lines of an omnils_ buffer, parsed once when the buffer is
+// read and stored as parallel arrays, sorted by object name. The fields are:
+// name, type, class, package (or environment), usage, title and description.
+// The buffer may be either converted by check_omils_buffer() or left as read
+// from the file (raw), with the fields terminated by '\006'. The arrays are
+// either allocated in a single block (arrays) or mapped from a compl_ file
+// (see compldb.h).
+typedef struct omnils_recs_ {
+    const char *buf;       // The omnils_ buffer
+    const char *nbuf;      // The names: either buf or names
+    char *names;           // Converted copies of the names if raw
+    void *arrays;          // The allocated arrays or NULL if mapped
+    const uint32_t *name;  // Offsets of the names in nbuf
+    const uint32_t *fld;   // Offsets in buf of the fields 1 to 6 and of the end
+                           // of the line, 7 per line
+    const uint16_t *nlen;  // Length of the name (at most UINT16_MAX)
+    const char *type;      // Type of object (first byte of field 1)
+    const uint32_t *nsep;  // Number of '@', '$' and '[' in the name, 8 bits each
+    const uint64_t *cmask; // Characters present in the name (see char_bit())
+    int raw;               // Are the fields in buf still not converted?
+    int n;                 // Number of lines
+} OmnilsRecs;
+
+// Position of the lines describing a .GlobalEnv object in the glbnv_buffer.
+// The block includes the lines of the elements of lists and S4 objects.
+typedef struct glbnv_block_ {
+    size_t start; // Offset of the first line of the object
+    size_t len;   // Number of bytes of all lines of the object
+} GlbnvBlock;
 
 // Structure for package data
 typedef struct pkg_data_ {
@@ -35,8 +97,15 @@ typedef struct pkg_data_ {
     char *version; // The package version number
     char *fname;   // Omnils_ file name in the compldir
     char *descr;   // The package short description
-    char *omnils;  // A copy of the omnils_ file
-    char *args;    // A copy of the args file
+    const char *omnils; // Either the omnils_ or the compl_ file mapped into
+                        // memory
+    size_t omnils_sz; // Size of omnils
+    OmnilsRecs recs;  // Parsed lines of omnils
+    NameHash *names;  // Records of omnils by object name, when first needed
+    const char *args; // The args_ file mapped into memory when first needed
+    size_t args_sz;   // Size of args
+    uint32_t *argo;   // Offsets of the lines of args
+    NameHash *fargs;  // Lines of args by function name
     int nobjs;     // Number of objects in the omnils
     int loaded;    // Loaded flag in libnames_
     int to_build;  // Flag to indicate if the name is sent to build list
@@ -0,0 +1,197 @@
+#include "obdiff.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Lines not rendered share the same empty string
+static int same_line(const char *a, const char *b) {
+    return a == b || strcmp(a, b) == 0;
+}
+
+/**
+ * @brief Finds the lines to delete and to insert to turn a into b with the
+ * greedy algorithm of Myers ("An O(ND) difference algorithm and its
+ * variations", 1986).
+ *
+ * The furthest reaching point of each diagonal is saved after each round, so
+ * that the path can be followed backwards from the end. That takes
+ * (maxd + 1)^2 values of memory.
+ *
+ * @param del Array of n flags set to 1 for the lines of a to delete.
+ * @param ins Array of m flags set to 1 for the lines of b to insert.
+ * @return 1 on success or 0 if there are more than maxd differences or not
+ * enough memory.
+ */
+static int myers(const char **a, long n, const char **b, long m, long maxd,
+                 char *del, char *ins) {
+    long off = maxd + 1;
+    long *v = malloc((2 * maxd + 3) * sizeof(long));
+    long *trace = malloc((maxd + 1) * (maxd + 1) * sizeof(long));
+    if (!v || !trace) {
+        free(v);
+        free(trace);
+        return 0;
+    }
+
+    long d, k, x, y;
+    int found = 0;
+    v[off + 1] = 0;
+    for (d = 0; d <= maxd && !found; d++) {
+        for (k = -d; k <= d; k += 2) {
+            if (k == -d || (k != d && v[off + k - 1] < v[off + k + 1]))
+                x = v[off + k + 1];
+            else
+                x = v[off + k - 1] + 1;
+            y = x - k;
+            while (x < n && y < m && same_line(a[x], b[y])) {
+                x++;
+                y++;
+            }
+            v[off + k] = x;
+            trace[d * d + d + k] = x;
+            if (x >= n && y >= m) {
+                found = 1;
+                break;
+            }
+        }
+    }
+    free(v);
+    if (!found) {
+        free(trace);
+        return 0;
+    }
+
+    // Follow the path backwards, from the round that reached the end
+    x = n;
+    y = m;
+    for (d--; d > 0; d--) {
+        const long *pv = trace + (d - 1) * (d - 1) + (d - 1);
+        long pk, px;
+        k = x - y;
+        if (k == -d || (k != d && pv[k - 1] < pv[k + 1]))
+            pk = k + 1;
+        else
+            pk = k - 1;
+        px = pv[pk];
+        if (pk == k + 1)
+            ins[px - pk] = 1;
+        else
+            del[px] = 1;
+        x = px;
+        y = px - pk;
+    }
+    free(trace);
+    return 1;
+}
+
+/**
+ * @brief Compares two renderings of the Object Browser.
+ *
+ * The lines common to the beginning and to the end of both renderings are
+ * skipped before looking for the differences. If there are more than maxd
+ * lines to delete or insert between them, the lines are compared in place if
+ * both renderings have the same number of lines. Otherwise, all of them are
+ * replaced in a single hunk.
+ *
+ * @param a Lines of the previous rendering.
+ * @param na Number of lines in a.
+ * @param b Lines of the new rendering.
+ * @param nb Number of lines in b.
+ * @param maxd Maximum number of deleted and inserted lines to look for.
+ * @param hunks Pointer to be set to the array of hunks, in the order of the
+ * lines, which must be freed by the caller.
+ * @return The number of hunks or -1 if there is not enough memory.
+ */
+long ob_diff(const char **a, long na, const char **b, long nb, long maxd,
+             ObHunk **hunks) {
+    long p = 0;
+    while (p < na && p < nb && same_line(a[p], b[p]))
+        p++;
+    long s = 0;
+    while (s < na - p && s < nb - p && same_line(a[na - 1 - s], b[nb - 1 - s]))
+        s++;
+
+    long n = na - p;
+    long m = nb - p;
+    n -= s;
+    m -= s;
+    *hunks = NULL;
+    if (n == 0 && m == 0)
+        return 0;
+
+    ObHunk *h = malloc((maxd + 1) * sizeof(ObHunk));
+    char *del = calloc(n + m + 1, 1);
+    if (!h) {
+        free(del);
+        return -1;
+    }
+
+    long nh = 0;
+    if (!del || n == 0 || m == 0 ||
+        !myers(a + p, n, b + p, m, maxd, del, del + n)) {
+        // If both have the same number of lines, probably other lines were
+        // scrolled into view: compare them in place
+        int inplace = n == m;
+        if (inplace && n / 2 + 1 > maxd + 1) {
+            ObHunk *g = realloc(h, (n / 2 + 1) * sizeof(ObHunk));
+            if (g)
+                h = g;
+            else
+                inplace = 0;
+        }
+        if (inplace) {
+            for (long i = 0; i < n;) {
+                if (same_line(a[p + i], b[p + i])) {
+                    i++;
+                    continue;
+                }
+                long i0 = i;
+                while (i < n && !same_line(a[p + i], b[p + i]))
+                    i++;
+                h[nh].a = p + i0;
+                h[nh].na = i - i0;
+                h[nh].b = p + i0;
+                h[nh].nb = i - i0;
+                nh++;
+            }
+        } else {
+            h[0].a = p;
+            h[0].na = n;
+            h[0].b = p;
+            h[0].nb = m;
+            nh = 1;
+        }
+    } else {
+        const char *ins = del + n;
+        long i = 0, j = 0;
+        while (i < n || j < m) {
+            if (i < n && j < m && !del[i] && !ins[j]) {
+                i++;
+                j++;
+                continue;
+            }
+            long i0 = i, j0 = j;
+            while ((i < n && del[i]) || (j < m && ins[j])) {
+                while (i < n && del[i])
+                    i++;
+                while (j < m && ins[j])
+                    j++;
+            }
+            if (i == i0 && j == j0) { // Should not happen
+                h[0].a = p;
+                h[0].na = n;
+                h[0].b = p;
+                h[0].nb = m;
+                nh = 1;
+                break;
+            }
+            h[nh].a = p + i0;
+            h[nh].na = i - i0;
+            h[nh].b = p + j0;
+            h[nh].nb = j - j0;
+            nh++;
+        }
+    }
+    free(del);
+    *hunks = h;
+    return nh;
+}
@@ -0,0 +1,16 @@
+#ifndef OBDIFF_H
+#define OBDIFF_H
+
+// A range of lines of the previous rendering of the Object Browser replaced
+// with a range of lines of the new rendering.
+typedef struct ob_hunk_ {
+    long a;  // First replaced line of the previous rendering
+    long na; // Number of replaced lines
+    long b;  // First replacement line of the new rendering
+    long nb; // Number of replacement lines
+} ObHunk;
+
+long ob_diff(const char **a, long na, const char **b, long nb, long maxd,
+             ObHunk **hunks);
+
+#endif // OBDIFF_H
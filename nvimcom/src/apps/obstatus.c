@@ -0,0 +1,148 @@
+#include "obstatus.h"
+#include "logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char obstatus_magic[8] = {'R', 'N', 'V', 'O', 'B', 'S', 'T', '\n'};
+
+/**
+ * @brief Returns the FNV-1a hash of the project directory, used in the name
+ * of its obstatus_ file.
+ */
+uint64_t obstatus_hash(const char *dir) {
+    uint64_t h = 14695981039346656037u;
+    for (const unsigned char *s = (const unsigned char *)dir; *s; s++) {
+        h ^= *s;
+        h *= 1099511628211u;
+    }
+    return h;
+}
+
+/**
+ * @brief Adds the status saved in an obstatus_ file to the table.
+ *
+ * @param t The table.
+ * @param fname Name of the obstatus_ file.
+ * @param dir The project directory.
+ * @return The number of lists read or -1 if the file does not exist or is not
+ * valid.
+ */
+int obstatus_load(ListStatusTable *t, const char *fname, const char *dir) {
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0L, SEEK_END);
+    long sz = ftell(f);
+    rewind(f);
+    char *b = malloc(sz > 0 ? sz : 1);
+    if (!b || sz < (long)sizeof(ObStatusHeader) ||
+        fread(b, 1, sz, f) != (size_t)sz) {
+        fclose(f);
+        free(b);
+        return -1;
+    }
+    fclose(f);
+
+    ObStatusHeader h;
+    memcpy(&h, b, sizeof(h));
+    size_t dlen = strlen(dir);
+    if (memcmp(h.magic, obstatus_magic, sizeof(h.magic)) != 0 ||
+        h.version != OBSTATUS_VERSION || h.byteorder != 0x01020304 ||
+        h.dirlen != dlen || sizeof(h) + dlen > (size_t)sz ||
+        memcmp(b + sizeof(h), dir, dlen) != 0) {
+        Log("obstatus_load: ignoring '%s'", fname);
+        free(b);
+        return -1;
+    }
+
+    char key[65536];
+    const char *p = b + sizeof(h) + dlen;
+    const char *end = b + sz;
+    uint32_t i;
+    for (i = 0; i < h.n && end - p >= 3; i++) {
+        uint16_t len;
+        memcpy(&len, p + 1, sizeof(len));
+        if (end - p - 3 < len)
+            break;
+        memcpy(key, p + 3, len);
+        key[len] = 0;
+        ListStatus *e = list_status_get(t, key);
+        if (!e)
+            e = list_status_add(t, key, p[0]);
+        e->status = p[0];
+        e->user = 1;
+        p += 3 + len;
+    }
+    free(b);
+    return i;
+}
+
+// Is the entry saved in the obstatus_ file?
+static int saved(const ListStatus *e) {
+    return e->user && strlen(e->key) <= UINT16_MAX;
+}
+
+/**
+ * @brief Writes the obstatus_ file of a project.
+ *
+ * Only the status set by the user is saved, so that the objbr_opendf and
+ * objbr_openlist options apply to the other lists in the next session. The
+ * file is written under a temporary name and then renamed, so that
+ * another rnvimserver in the same project never reads an incomplete file.
+ *
+ * @param t The table.
+ * @param fname Name of the obstatus_ file.
+ * @param dir The project directory.
+ * @return 1 on success or 0 on failure.
+ */
+int obstatus_save(const ListStatusTable *t, const char *fname,
+                  const char *dir) {
+    // Keep only the OBSTATUS_MAX last entries set by the user
+    unsigned int first = t->n;
+    unsigned int n = 0;
+    while (first > 0 && n < OBSTATUS_MAX)
+        if (saved(list_status_at(t, --first)))
+            n++;
+
+    ObStatusHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, obstatus_magic, sizeof(h.magic));
+    h.version = OBSTATUS_VERSION;
+    h.byteorder = 0x01020304;
+    h.dirlen = strlen(dir);
+    h.n = n;
+
+    char tmp[1040];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", fname, (long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        Log("obstatus_save: could not open '%s'", tmp);
+        return 0;
+    }
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(dir, 1, h.dirlen, f) == h.dirlen;
+    for (unsigned int i = first; ok && i < t->n; i++) {
+        const ListStatus *e = list_status_at(t, i);
+        if (!saved(e))
+            continue;
+        size_t len = strlen(e->key);
+        uint16_t l16 = len;
+        ok = fputc(e->status, f) != EOF &&
+             fwrite(&l16, sizeof(l16), 1, f) == 1 &&
+             fwrite(e->key, 1, len, f) == len;
+    }
+    if (fclose(f) != 0)
+        ok = 0;
+#ifdef WIN32
+    if (ok)
+        remove(fname);
+#endif
+    if (!ok || rename(tmp, fname) != 0) {
+        Log("obstatus_save: could not write '%s'", fname);
+        remove(tmp);
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,40 @@
+#ifndef OBSTATUS_H
+#define OBSTATUS_H
+
+#include "data_structures.h"
+
+// obstatus_<hash> files keep the open/closed status that the user set for the
+// lists and libraries of the Object Browser of a project, that is, of the
+// working directory where R.nvim was started, whose hash is in the file name.
+// The file has:
+//
+//   - An ObStatusHeader.
+//
+//   - The project directory (dirlen bytes).
+//
+//   - n records with the status (1 byte), the length of the key (2 bytes) and
+//     the key, without the NULL byte.
+//
+// The file is ignored if its version or the byte order do not match or if it
+// belongs to another directory with the same hash.
+
+#define OBSTATUS_VERSION 1
+
+// Maximum number of lists saved. The most recently added ones are kept.
+// Lists whose status was not set by the user are not saved.
+#define OBSTATUS_MAX 65536
+
+typedef struct obstatus_header_ {
+    char magic[8];      // "RNVOBST\n"
+    uint32_t version;   // OBSTATUS_VERSION
+    uint32_t byteorder; // 0x01020304 as written by the machine
+    uint32_t n;         // Number of records
+    uint32_t dirlen;    // Length of the project directory
+} ObStatusHeader;
+
+uint64_t obstatus_hash(const char *dir);
+int obstatus_load(ListStatusTable *t, const char *fname, const char *dir);
+int obstatus_save(const ListStatusTable *t, const char *fname,
+                  const char *dir);
+
+#endif // OBSTATUS_H
@@ -1,5 +1,6 @@
 #include <ctype.h>     // Character type functions
 #include <dirent.h>    // Directory entry
+#include <limits.h>    // INT_MAX
 #include <signal.h>    // Signal handling
 #include <stdarg.h>    // Variable argument functions
 #include <stdio.h>     // Standard input/output definitions
@@ -23,16 +24,27 @@ HWND RConsole = NULL;
 #define PRI_SIZET PRIu32
 #endif
 #else
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
-#include <pthread.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
 #define PRI_SIZET "zu"
 #endif
 
+#include "compldb.h"
 #include "data_structures.h"
 #include "logging.h"
+#include "obdiff.h"
+#include "obstatus.h"
+#include "scan.h"
 #include "utilities.h"
 
 static char strL[8];        // String for last element prefix in tree view
@@ -41,33 +53,127 @@ static int OpenDF;          // Flag for open data frames in tree view
 static int OpenLS;          // Flag for open lists in tree view
 static int nvimcom_is_utf8; // Flag for UTF-8 encoding
 static int allnames; // Flag for showing all names, including starting with '.'
+static int max_compl; // Maximum number of completion items (0 = no limit)
+static int compl_offset; // Offset of the page requested by the client
+static int compl_skip; // Items still to be skipped in the current completion
+static int compl_left; // Items still to be added in the current completion
+static int compl_more; // Items left out of the current completion
+
+#ifdef Debug_NRS
+// Bytes of omnils data (names, fields and record arrays) read by the current
+// completion. It is written to the log at the end of each completion.
+static size_t compl_touched;
+#define TOUCHED(n) (compl_touched += (n))
+#define LOG_TOUCHED(f)                                                         \
+    (Log("%s: %zu bytes of omnils data read", f, compl_touched),               \
+     compl_touched = 0)
+#else
+#define TOUCHED(n) ((void)0)
+#define LOG_TOUCHED(f) ((void)0)
+#endif
+
+// Range of a sorted index with the names matching the last completion base
+typedef struct compl_range_ {
+    const OmnilsRecs *recs; // glbnv_recs or the recs of a package
+    int first;        // First name beginning with the base
+    int last;         // One past the last name beginning with the base
+    PkgData *pd;      // The package or NULL for .GlobalEnv
+} ComplRange;
+
+// Text of a view of the Object Browser being rendered
+typedef struct ob_text_ {
+    char *b;    // The lines
+    size_t len; // Length of the text
+    size_t sz;  // Allocated size of b
+} ObText;
+
+// Line of a view of the Object Browser
+typedef struct ob_line_ {
+    const char *name;  // Name of the object or text of a header line
+    const char *descr; // Description of the object
+    char type;         // Type of the object or 0 for header lines
+    char raw;          // Display name and descr as they are
+    size_t prfx;       // Offset of the prefix in ObIndex.prfx
+    long parent;       // Line of the parent object or -1
+} ObLine;
+
+// Index of the lines of a view of the Object Browser. Only the lines in view
+// are rendered, but all of them are indexed to know their positions.
+typedef struct ob_index_ {
+    ObLine *l;       // The lines
+    long n;          // Number of lines
+    long sz;         // Allocated size of l
+    ObText prfx;     // Prefixes of the lines, each followed by a NULL byte
+    size_t lastprfx; // Offset of the last prefix
+} ObIndex;
+
+// A view of the Object Browser: its index and the rendering last sent to
+// Neovim
+typedef struct ob_view_ {
+    const char *name;      // View name as known by browser.lua
+    ObIndex ix;            // Index of the lines or ix.n = 0 if not built
+    char *text;            // The lines, with NULL bytes in place of newlines
+    const char **line;     // Beginning of each line in text
+    long n;                // Number of lines
+    unsigned long version; // Number of renderings sent
+    long top;              // First line in view in the Object Browser
+    long bot;              // Line following the last one in view
+} ObView;
+
+// Maximum number of changed lines looked for by ob_diff()
+#define OB_MAX_DIFF 256
+
+// Number of lines rendered above and below the lines in view
+#define OB_MARGIN 100
+
+static ComplRange *crange;  // Ranges matching the last completion base
+static int ncrange;         // Number of ranges in crange
+static int crange_sz;       // Allocated size of crange
+static char crange_base[512]; // The last completion base
+static int crange_valid;    // Can crange be refined by the next completion?
 
 static char compl_cb[64];      // Completion callback buffer
 static char compl_info[64];    // Completion info buffer
 static char compldir[256];     // Directory for completion files
 static char tmpdir[256];       // Temporary directory
 static char localtmpdir[256];  // Local temporary directory
-static char liblist[576];      // Library list buffer
-static char globenv[576];      // Global environment buffer
 static int auto_obbr;          // Auto object browser flag
+static ObView ob_glbnv = {.name = "GlobalEnv", .bot = 100}; // GlobalEnv view
+static ObView ob_libs = {.name = "libraries", .bot = 100};  // Libraries view
+static ObView *ob_shown = &ob_glbnv; // View shown in the OB
 static size_t glbnv_buffer_sz; // Global environment buffer size
 static char *glbnv_buffer;     // Global environment buffer
+static GlbnvBlock *glbnv_blk;  // Position of each object in glbnv_buffer
+static int glbnv_nblk;         // Number of objects in glbnv_buffer
+static OmnilsRecs glbnv_recs;  // Parsed lines of glbnv_buffer
+static NameHash *glbnv_names;  // Records of glbnv_buffer by name
+static int glbnv_blk_sz;       // Allocated size of glbnv_blk
+static unsigned long glbnv_seq; // Sequence number of the last +D message
 static char *compl_buffer;     // Completion buffer
 static char *finalbuffer;      // Final buffer for message processing
 static unsigned long compl_buffer_size = 32768; // Completion buffer size
 static unsigned long fb_size = 1024;            // Final buffer size
 static int n_omnils_build;                      // number of omni lists to build
+static int build_workers;  // Number of R processes building omni lists
+static int build_helper;   // Build cache files in a persistent R process
 static int building_omnils;                     // Flag for building Omni lists
 static int more_to_build;                       // Flag for more lists to build
-static int has_args_to_read;                    // Flag for args to read
 
 void omni2ob(void);                 // Convert Omni completion to Object Browser
 void lib2ob(void);                  // Convert Library to object browser
 void update_inst_libs(void);        // Update installed libraries
 void update_pkg_list(char *libnms); // Update package list
 void update_glblenv_buffer(char *g); // Update global environment buffer
+void apply_glblenv_delta(char *d);   // Patch global environment buffer
+static int find_glbnv_block(const char *nm, int from); // Find .GlobalEnv obj
 static void build_omnils(void);      // Build Omni lists
+static void end_build_omnils(void);  // Finish or restart building of lists
+static void finish_pkg_bol(PkgData *pkg); // Finish building of a list
 static void finish_bol(void);            // Finish building of lists
+static void ob_drop_index(ObView *v);    // Forget the index of an OB view
+#ifndef WIN32
+static int bol_args_pending(const char *pkg); // Is an args_ file being built?
+#endif
 void complete(const char *id, char *base, char *funcnm,
               char *args); // Perform completion
 
@@ -75,7 +181,17 @@ LibPath *libpaths; // Pointer to first library path
 
 InstLibs *instlibs; // Pointer to first installed library
 
-static ListStatus *listTree; // Root node of the list status tree
+static ListStatusTable *listTree; // Status of lists in the Object Browser
+static ListStatusTable *expTree;  // Paths whose expansion was requested to
+                                  // nvimcom. The status is the value of
+                                  // nvimcom_session when the request was
+                                  // sent.
+static int list_status_loaded;    // Was the obstatus_ file read?
+static int list_status_changed;   // Was any list opened or closed?
+static char obstatus_fname[1040]; // The obstatus_ file of the project
+static char project_dir[768];     // Working directory when R.nvim started
+static int nvimcom_session;  // Incremented at each connection with nvimcom
+static char exp_msg[1024];   // Paths to be sent to nvimcom for expansion
 
 PkgData *pkgList;    // Pointer to first package data
 static int nLibObjs; // Number of library objects
@@ -86,12 +202,13 @@ static int VimSecretLen;    // Length of Vim secret
 
 #ifdef WIN32
 static int Tid; // Thread ID
-#else
-static pthread_t Tid; // Thread ID
 #endif
 struct sockaddr_in servaddr; // Server address structure
 static int sockfd;           // socket file descriptor
 static int connfd;           // Connection file descriptor
+#ifndef WIN32
+static char sock_path[108]; // Path to the Unix domain socket, if any
+#endif
 
 static void
 HandleSigTerm(__attribute__((unused)) int s) // Signal handler for SIGTERM
@@ -106,6 +223,19 @@ static void RegisterPort(int bindportn) // Function to register port number to R
     fflush(stdout);
 }
 
+#ifndef WIN32
+static void RegisterSocket(void) // Register the Unix socket path to R
+{
+    printf("lua require('r.run').set_nrs_socket('%s')\n", sock_path);
+    fflush(stdout);
+}
+
+static void remove_socket_file(void) {
+    if (sock_path[0])
+        unlink(sock_path);
+}
+#endif
+
 static void ParseMsg(char *b) // Parse the message from R
 {
 #ifdef Debug_NRS
@@ -125,6 +255,12 @@ static void ParseMsg(char *b) // Parse the message from R
                            // message to Nvim-R to
                 omni2ob(); // avoid unnecessary delays in omni completion
             break;
+        case 'D':
+            b++;
+            apply_glblenv_delta(b);
+            if (auto_obbr)
+                omni2ob();
+            break;
         case 'L':
             b++;
             update_pkg_list(b);
@@ -202,37 +338,88 @@ static void initialize_socket(void) {
  *
  * This function initializes the server address structure and attempts to bind
  * the server socket to an available port starting from 10101 up to 10199.
- * It registers the port number for R to connect. The function exits the
- * program if it fails to bind the socket to any of the ports in the specified
- * range.
+ * The function exits the program if it fails to bind the socket to any of the
+ * ports in the specified range.
+ *
+ * @return The port number.
  */
-static void bind_to_port(void) {
+static int bind_to_port(void) {
     Log("bind_to_port()");
 
     bzero(&servaddr, sizeof(servaddr));
     servaddr.sin_family = AF_INET;
     servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
 
-    int res = 1;
+    int res;
     for (int port = PORT_START; port <= PORT_END; port++) {
         servaddr.sin_port = htons(port);
         res = bind(sockfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
         if (res == 0) {
-            RegisterPort(port);
             Log("bind_to_port: Bind succeeded on port %d", port);
-            break;
+            return port;
         }
     }
-    if (res != 0) {
-        fprintf(stderr, "Failed to bind any port in the range %d-%d\n",
-                PORT_START, PORT_END);
-        fflush(stderr);
+    fprintf(stderr, "Failed to bind any port in the range %d-%d\n", PORT_START,
+            PORT_END);
+    fflush(stderr);
 #ifdef WIN32
-        WSACleanup();
+    WSACleanup();
 #endif /* ifdef WIN32 */
-        exit(2);
+    exit(2);
+}
+
+#ifndef WIN32
+/**
+ * @brief Creates a Unix domain socket in the temporary directory.
+ *
+ * When R and Neovim run on the same machine (RNVIM_UNIX_SOCKET is set by
+ * R.nvim if `remote_compldir` is empty), nvimcom connects through a Unix
+ * domain socket instead of a TCP port on the loopback interface. This is
+ * faster and avoids running out of ports when many sessions are running on the
+ * same machine. Since the socket is created with permissions restricted to
+ * the user, other users cannot connect to it.
+ *
+ * @return 1 if the socket was created and bound, and 0 if TCP must be used.
+ */
+static int bind_to_unix_socket(void) {
+    Log("bind_to_unix_socket()");
+    if (!getenv("RNVIM_UNIX_SOCKET"))
+        return 0;
+
+    struct sockaddr_un addr;
+    bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    int len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/nrs_socket_%s",
+                       tmpdir, getenv("RNVIM_ID"));
+    if (len < 0 || len >= (int)sizeof(addr.sun_path)) {
+        Log("bind_to_unix_socket: path too long; falling back to TCP");
+        return 0;
+    }
+
+    sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        Log("bind_to_unix_socket: socket creation failed; falling back to TCP");
+        return 0;
+    }
+
+    // The file might have been left by a previous rnvimserver that crashed
+    unlink(addr.sun_path);
+    mode_t old_mask = umask(0077);
+    int res = bind(sockfd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (res != 0) {
+        Log("bind_to_unix_socket: bind failed; falling back to TCP");
+        close(sockfd);
+        return 0;
     }
+
+    if (sock_path[0] == 0)
+        atexit(remove_socket_file);
+    strcpy(sock_path, addr.sun_path);
+    Log("bind_to_unix_socket: Bind succeeded on %s", sock_path);
+    return 1;
 }
+#endif
 
 /**
  * @brief Sets the server to listen for incoming connections.
@@ -256,8 +443,8 @@ static void listening_for_connections(void) {
 /**
  * @brief Accepts an incoming connection on the listening socket.
  *
- * This function waits for and accepts the first incoming connection request
- * on the listening socket. It stores the connection file descriptor in
+ * This function accepts the first incoming connection request on the
+ * listening socket. It stores the connection file descriptor in
  * 'connfd' and sets the 'r_conn' flag to indicate a successful connection.
  * The function exits the program if it fails to accept a connection.
  */
@@ -268,7 +455,7 @@ static void accept_connection(void) {
 #else
     socklen_t len;
 #endif
-    struct sockaddr_in cli;
+    struct sockaddr_storage cli;
 
     len = sizeof(cli);
     connfd = accept(sockfd, (struct sockaddr *)&cli, &len);
@@ -277,7 +464,14 @@ static void accept_connection(void) {
         fflush(stderr);
         exit(4);
     }
+    // Messages sent back to back (e.g. "F" and the paths to expand) should
+    // not wait for the delayed ACK of the previous one. This fails on Unix
+    // domain sockets, where it is not needed.
+    int one = 1;
+    setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, (const char *)&one,
+               sizeof(one));
     r_conn = 1;
+    nvimcom_session++;
     Log("accept_connection: accept succeeded");
 }
 
@@ -287,7 +481,9 @@ static void accept_connection(void) {
  * This function is responsible for the entire process of setting up the
  * server to listen for and accept incoming connections. It calls a series of
  * functions to initialize the socket, bind it to a port, set it to listen
- * for connections, and then accept an incoming connection.
+ * for connections, and then, on Windows, accept an incoming connection. On
+ * Unix, the connection is accepted by event_loop() when the listening socket
+ * becomes readable.
  *
  * @note A previous version of this function was adapted from
  * https://www.geeksforgeeks.org/socket-programming-in-cc-handling-multiple-clients-on-server-without-multi-threading/
@@ -296,10 +492,49 @@ static void
 setup_server_socket(void) // Initialise listening for incoming connections
 {
     Log("setup_server_socket()");
+#ifndef WIN32
+    if (bind_to_unix_socket()) {
+        listening_for_connections();
+        RegisterSocket();
+        return;
+    }
+#endif
     initialize_socket();
-    bind_to_port();
+    int port = bind_to_port();
     listening_for_connections();
+    // Register the port only after listen() to avoid a connection refused if
+    // R is fast enough.
+    RegisterPort(port);
+#ifdef WIN32
     accept_connection();
+#endif
+}
+
+/**
+ * @brief Reads exactly `len` bytes from the nvimcom connection.
+ *
+ * `recv()` may return fewer bytes than requested, mainly when a big message
+ * is split in many TCP segments. This function calls it as many times as
+ * necessary to fill the buffer.
+ *
+ * @param buf Destination buffer.
+ * @param len Number of bytes to read.
+ * @return 1 on success and 0 if the connection was closed or an error
+ * occurred.
+ */
+static int recv_all(char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+#ifdef WIN32
+        int r = recv(connfd, buf + got, (int)(len - got), 0);
+#else
+        ssize_t r = recv(connfd, buf + got, len - got, 0);
+#endif
+        if (r <= 0)
+            return 0;
+        got += r;
+    }
+    return 1;
 }
 
 static void get_whole_msg(char *b) // Get the whole message from the socket
@@ -307,7 +542,7 @@ static void get_whole_msg(char *b) // Get the whole message from the socket
     Log("get_whole_msg()");
     char *p;
     char tmp[1];
-    int msg_size;
+    size_t msg_size;
 
     if (strstr(b, VimSecret) != b) {
         fprintf(stderr, "Strange string received {%s}: \"%s\"\n", VimSecret, b);
@@ -318,90 +553,88 @@ static void get_whole_msg(char *b) // Get the whole message from the socket
 
     // Get the message size
     p[9] = 0;
-    msg_size = atoi(p);
-    p += 10;
-
-    // Allocate enough memory to the final buffer
-    if (finalbuffer) {
-        memset(finalbuffer, 0, fb_size);
-        if (msg_size > fb_size)
-            finalbuffer =
-                grow_buffer(&finalbuffer, &fb_size, msg_size - fb_size + 1024);
-    } else {
-        if (msg_size > fb_size)
+    msg_size = strtoul(p, NULL, 10);
+
+    // Reuse the final buffer, replacing it only when it is too small. There
+    // is no need to preserve its contents.
+    if (!finalbuffer || msg_size >= fb_size) {
+        free(finalbuffer);
+        if (msg_size >= fb_size)
             fb_size = msg_size + 1024;
-        finalbuffer = calloc(fb_size, sizeof(char));
+        finalbuffer = malloc(fb_size * sizeof(char));
     }
 
-    p = finalbuffer;
-    for (;;) {
-        if ((recv(connfd, tmp, 1, 0) == 1))
-            *p = *tmp;
-        else
-            break;
-        if (*p == '\x11')
-            break;
-        p++;
+    // Trust the size in the header and read the whole body at once. The
+    // message is followed by a final \x11 byte.
+    if (!recv_all(finalbuffer, msg_size) || !recv_all(tmp, 1)) {
+        fprintf(stderr, "Incomplete TCP message: expected %" PRI_SIZET
+                        " bytes\n", msg_size);
+        fflush(stderr);
+        return;
     }
-    *p = 0;
+    finalbuffer[msg_size] = 0;
 
-    // FIXME: Delete this check when the code proved to be reliable
-    if (strlen(finalbuffer) != msg_size) {
-        fprintf(stderr, "Divergent TCP message size: %" PRI_SIZET " x %d\n",
-                strlen(p), msg_size);
+    if (*tmp != '\x11') {
+        fprintf(stderr, "Divergent TCP message size: %" PRI_SIZET
+                        " (final byte: %d)\n", msg_size, *tmp);
         fflush(stderr);
     }
 
     ParseMsg(finalbuffer);
 }
 
+/**
+ * @brief Closes the connection with nvimcom.
+ */
+static void close_connection(void) {
+    r_conn = 0;
 #ifdef WIN32
-static void
-receive_msg(void *arg) // Thread function to receive messages on Windows
+    closesocket(sockfd);
+    WSACleanup();
 #else
-static void *receive_msg(void *v) // Thread function to receive messages on Unix
+    close(connfd);
+    close(sockfd);
+    connfd = 0;
+    sockfd = -1;
+    remove_socket_file();
 #endif
-{
+}
+
+/**
+ * @brief Receives a single message from nvimcom and processes it.
+ *
+ * @return 0 if the connection was closed and 1 otherwise.
+ */
+static int receive_msg(void) {
     size_t blen = VimSecretLen + 9;
-    char b[32];
-    size_t rlen;
+    char b[160];
+
+    bzero(b, sizeof(b));
+    if (!recv_all(b, blen))
+        return 0;
+    Log("TCP in [%" PRI_SIZET " bytes] (message header): %s", blen, b);
+    get_whole_msg(b);
+    return 1;
+}
 
-    for (;;) {
-        bzero(b, blen);
-        rlen = recv(connfd, b, blen, 0);
-        if (rlen == blen) {
-            Log("TCP in [%" PRI_SIZET " bytes] (message header): %s", blen, b);
-            get_whole_msg(b);
-        } else {
-            r_conn = 0;
 #ifdef WIN32
-            closesocket(sockfd);
-            WSACleanup();
-#else
-            close(sockfd);
-#endif
-            if (rlen != -1 && rlen != 0) {
-                fprintf(stderr, "TCP socket -1: restarting...\n");
-                fprintf(stderr,
-                        "Wrong TCP data length: %" PRI_SIZET " x %" PRI_SIZET
-                        "\n",
-                        blen, rlen);
-                fflush(stderr);
-            }
-            break;
-        }
-    }
-#ifndef WIN32
-    return NULL;
-#endif
+static void
+receive_msg_loop(void *arg) // Thread function to receive messages on Windows
+{
+    while (receive_msg())
+        ;
+    close_connection();
 }
+#endif
 
 void send_to_nvimcom(
     char *msg) // Function to send messages to R (nvimcom package)
 {
     Log("TCP out: %s", msg);
     if (connfd) {
-        size_t len = strlen(msg);
+        // The final NULL byte delimits the message, since nvimcom might
+        // receive several ones, or part of one, with each recv().
+        size_t len = strlen(msg) + 1;
         if (send(connfd, msg, len, 0) != (ssize_t)len) {
             fprintf(stderr, "Partial/failed write.\n");
             fflush(stderr);
@@ -626,60 +859,13 @@ void start_server(void) // Start server and listen for connections
 
     setup_server_socket();
 
-    // Receive messages from TCP and output them to stdout
+    // Receive messages from TCP and output them to stdout. On Unix, both the
+    // connection and the messages are handled by event_loop().
 #ifdef WIN32
-    Tid = _beginthread(receive_msg, 0, NULL);
-#else
-    pthread_create(&Tid, NULL, receive_msg, NULL);
+    Tid = _beginthread(receive_msg_loop, 0, NULL);
 #endif
 }
 
-/**
- * @brief Count the number of separator characters in a given buffer.
- *
- * This function scans a buffer and counts the number of occurrences of
- * the separator character '\006'. It is primarily used to parse and validate
- * data structure representations received from R. The function also checks if
- * the size of the buffer is 1, indicating an empty package with no exported
- * objects. In case of an unexpected number of separators, it logs an error,
- * frees the buffer, and returns NULL.
- *
- * @param b1 Pointer to the buffer to be scanned.
- * @param size Pointer to an integer where the size of the buffer will be
- * stored.
- * @return Returns the original buffer if the count of separators is as
- * expected. Returns NULL in case of an error or if the count is not as
- * expected.
- */
-char *count_sep(char *b1, int *size) {
-    *size = strlen(b1);
-    // Some packages do not export any objects.
-    if (*size == 1)
-        return b1;
-
-    char *s = b1;
-    int n = 0;
-    while (*s) {
-        if (*s == '\006')
-            n++;
-        if (*s == '\n') {
-            if (n == 7) {
-                n = 0;
-            } else {
-                char b[64];
-                s++;
-                strncpy(b, s, 16);
-                fprintf(stderr, "Number of separators: %d (%s)\n", n, b);
-                fflush(stderr);
-                free(b1);
-                return NULL;
-            }
-        }
-        s++;
-    }
-    return b1;
-}
-
 /**
  * @brief Reads the entire contents of a specified file into a buffer.
  *
@@ -733,6 +919,66 @@ char *read_file(const char *fn, int verbose) {
     return buffer;
 }
 
+/**
+ * @brief Maps a file into memory for reading only, so that the pages of the
+ * file are shared by all processes reading it. On Windows, the file is read
+ * into a buffer.
+ *
+ * A mapped file must never be truncated: reading its missing pages would
+ * raise SIGBUS. nvimcom (bol.R) and compldb_write() write the cache files
+ * under a temporary name and rename them, so a mapping keeps the old file.
+ *
+ * @param fn The name of the file.
+ * @param verbose Flag to indicate whether to print error messages.
+ * @param sz Pointer to be set to the size of the file.
+ * @return Pointer to the contents of the file, which is not NULL terminated,
+ * or NULL if the file cannot be opened or is empty.
+ */
+static const char *map_file(const char *fn, int verbose, size_t *sz) {
+#ifdef WIN32
+    // Not strlen() because compl_ files have NULL bytes
+    struct stat st;
+    if (stat(fn, &st) != 0 || st.st_size == 0)
+        return read_file(fn, verbose);
+    char *b = read_file(fn, verbose);
+    *sz = b ? st.st_size : 0;
+    return b;
+#else
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        if (verbose) {
+            fprintf(stderr, "Error opening '%s'", fn);
+            fflush(stderr);
+        }
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *b = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (b == MAP_FAILED) {
+        fprintf(stderr, "Error mapping '%s': %s\n", fn, strerror(errno));
+        fflush(stderr);
+        return NULL;
+    }
+    *sz = st.st_size;
+    return b;
+#endif
+}
+
+static void unmap_file(const char *b, size_t sz) {
+    if (!b)
+        return;
+#ifdef WIN32
+    free((char *)b);
+#else
+    munmap((void *)b, sz);
+#endif
+}
+
 /**
  * @brief Validates and prepares the buffer containing Omni completion data.
  *
@@ -740,64 +986,42 @@ char *read_file(const char *fn, int verbose) {
  * completion, ensuring that there are exactly 7 '\006' separators between
  * newline characters. It modifies the buffer in place, replacing certain
  * control characters with their corresponding representations and ensuring the
- * data is correctly formatted for subsequent processing. The function is part
- * of the handling for Omni completion data in the Nvim-R plugin, facilitating
- * the communication and data exchange between Neovim and R.
+ * data is correctly formatted for subsequent processing. The validation,
+ * conversion and counting of lines are done in a single pass by
+ * scan_omnils(). In case of an unexpected number of separators, it logs an
+ * error and frees the buffer.
  *
  * @param buffer Pointer to the buffer containing Omni completion data.
- * @param size Pointer to an integer representing the size of the buffer.
+ * @param size Pointer to an integer where the size of the buffer will be
+ * stored.
+ * @param nlines Pointer to an integer where the number of lines will be
+ * stored.
  * @return Returns a pointer to the processed buffer if the validation is
  * successful. Returns NULL if the buffer does not meet the expected format or
  * validation fails.
  */
-void *check_omils_buffer(char *buffer, int *size) {
-    // Ensure that there are exactly 7 \006 between new line characters
-    buffer = count_sep(buffer, size);
-
-    if (!buffer)
+void *check_omils_buffer(char *buffer, int *size, int *nlines) {
+    *size = strlen(buffer);
+    *nlines = 0;
+    // Some packages do not export any objects.
+    if (*size == 1)
+        return buffer;
+
+    size_t bad;
+    long n = scan_omnils(buffer, *size, &bad);
+    if (n < 0) {
+        char b[64];
+        strncpy(b, buffer + bad, 16);
+        b[16] = 0;
+        fprintf(stderr, "Number of separators is not 7 (%s)\n", b);
+        fflush(stderr);
+        free(buffer);
         return NULL;
-
-    if (buffer) {
-        char *p = buffer;
-        while (*p) {
-            if (*p == '\006')
-                *p = 0;
-            if (*p == '\'')
-                *p = '\x13';
-            if (*p == '\x12')
-                *p = '\'';
-            p++;
-        }
     }
+    *nlines = n;
     return buffer;
 }
 
-/**
- * @brief Reads the contents of an Omni completion list file into a buffer.
- *
- * This function opens and reads the specified Omni completion file (typically
- * named 'omnils_'). It allocates memory for the buffer and loads the file
- * contents into it. The buffer is used to store completion items (like function
- * names and variables) available in R packages for use in Omni completion in
- * Neovim. If the file is empty, it indicates that no completion items are
- * available or the file is yet to be populated.
- *
- * @param fn The name of the file to be read.
- * @param size A pointer to an integer where the size of the read data will be
- * stored.
- * @return Returns a pointer to a buffer containing the file contents if
- * successful. Returns NULL if the file cannot be opened, is empty, or in case
- * of a read error.
- */
-char *read_omnils_file(const char *fn, int *size) {
-    Log("read_omnils_file(%s)", fn);
-    char *buffer = read_file(fn, 1);
-    if (!buffer)
-        return NULL;
-
-    return check_omils_buffer(buffer, size);
-}
-
 char *get_pkg_descr(const char *pkgnm) {
     Log("get_pkg_descr(%s)", pkgnm);
     InstLibs *il = instlibs;
@@ -813,86 +1037,404 @@ char *get_pkg_descr(const char *pkgnm) {
     return NULL;
 }
 
+static void free_omnils_recs(OmnilsRecs *r) {
+    free(r->arrays);
+    free(r->names);
+    memset(r, 0, sizeof(OmnilsRecs));
+}
+
+/**
+ * @brief Unmaps the args_ file of a package, which will be mapped again when
+ * needed.
+ */
+static void unmap_pkg_args(PkgData *pd) {
+    unmap_file(pd->args, pd->args_sz);
+    free(pd->argo);
+    free_NameHash(pd->fargs);
+    pd->args = NULL;
+    pd->args_sz = 0;
+    pd->argo = NULL;
+    pd->fargs = NULL;
+}
+
 void pkg_delete(PkgData *pd) {
+    ob_drop_index(&ob_libs);
     free(pd->name);
     free(pd->version);
     free(pd->fname);
     if (pd->descr)
         free(pd->descr);
-    if (pd->omnils)
-        free(pd->omnils);
-    if (pd->args)
-        free(pd->args);
+    unmap_file(pd->omnils, pd->omnils_sz);
+    crange_valid = 0;
+    free_omnils_recs(&pd->recs);
+    free_NameHash(pd->names);
+    unmap_pkg_args(pd);
     free(pd);
 }
 
-void load_pkg_data(PkgData *pd) {
-    int size;
-    if (!pd->descr)
-        pd->descr = get_pkg_descr(pd->name);
-    pd->omnils = read_omnils_file(pd->fname, &size);
-    pd->nobjs = 0;
-    if (pd->omnils) {
-        pd->loaded = 1;
-        if (size > 2)
-            for (int i = 0; i < size; i++)
-                if (pd->omnils[i] == '\n')
-                    pd->nobjs++;
-    }
+// A line of an omnils_ buffer and its name
+typedef struct named_line_ {
+    const char *name; // The name (converted and NULL terminated)
+    const char *line; // The line
+} NamedLine;
+
+// Lines with the same name are kept in the order of the buffer
+static int compare_named_lines(const void *a, const void *b) {
+    const NamedLine *x = a;
+    const NamedLine *y = b;
+    int cmp = strcmp(x->name, y->name);
+    if (cmp == 0)
+        return x->line < y->line ? -1 : x->line > y->line;
+    return cmp;
 }
 
-PkgData *new_pkg_data(const char *nm, const char *vrsn) {
-    char buf[1024];
-
-    PkgData *pd = calloc(1, sizeof(PkgData));
-    pd->name = malloc((strlen(nm) + 1) * sizeof(char));
-    strcpy(pd->name, nm);
-    pd->version = malloc((strlen(vrsn) + 1) * sizeof(char));
-    strcpy(pd->version, vrsn);
-    pd->descr = get_pkg_descr(pd->name);
-    pd->loaded = 1;
+/**
+ * @brief Returns the bit representing a character in the masks used to
+ * discard candidates in fuzzy completion. Letters are case insensitive.
+ */
+static uint64_t char_bit(unsigned char c) {
+    if (c >= 'a' && c <= 'z')
+        return (uint64_t)1 << (c - 'a');
+    if (c >= 'A' && c <= 'Z')
+        return (uint64_t)1 << (c - 'A');
+    if (c >= '0' && c <= '9')
+        return (uint64_t)1 << (26 + c - '0');
+    switch (c) {
+    case '_':
+        return (uint64_t)1 << 36;
+    case '.':
+        return (uint64_t)1 << 37;
+    case '$':
+        return (uint64_t)1 << 38;
+    case '@':
+        return (uint64_t)1 << 39;
+    case '[':
+        return (uint64_t)1 << 40;
+    default:
+        return (uint64_t)1 << 63;
+    }
+}
 
-    snprintf(buf, 1023, "%s/omnils_%s_%s", compldir, nm, vrsn);
-    pd->fname = malloc((strlen(buf) + 1) * sizeof(char));
-    strcpy(pd->fname, buf);
+static uint64_t name_mask(const char *s) {
+    uint64_t m = 0;
+    while (*s)
+        m |= char_bit((unsigned char)*s++);
+    return m;
+}
 
-    // Check if both fun_ and omnils_ exist
-    pd->built = 1;
-    if (access(buf, F_OK) != 0) {
-        pd->built = 0;
-    } else {
-        snprintf(buf, 1023, "%s/fun_%s_%s", compldir, nm, vrsn);
-        if (access(buf, F_OK) != 0)
-            pd->built = 0;
+/**
+ * @brief Returns the number of '@', '$' and '[' in a name, packed in 8 bits
+ * each. Elements of lists are completed only if the base has as many of
+ * these characters as their names.
+ */
+static uint32_t name_seps(const char *s) {
+    uint32_t a = 0, d = 0, b = 0;
+    for (; *s; s++) {
+        if (*s == '@' && a < 255)
+            a++;
+        else if (*s == '$' && d < 255)
+            d++;
+        else if (*s == '[' && b < 255)
+            b++;
     }
-    return pd;
+    return a | d << 8 | b << 16;
 }
 
-PkgData *get_pkg(const char *nm) {
-    if (!pkgList)
-        return NULL;
-
-    PkgData *pd = pkgList;
-    do {
-        if (strcmp(pd->name, nm) == 0)
-            return pd;
-        pd = pd->next;
-    } while (pd);
+/**
+ * @brief Parses the lines of an omnils buffer into records sorted by object
+ * name, so that the objects whose names begin with a given prefix can be found
+ * with a binary search, and their fields can be read without scanning the
+ * lines again.
+ *
+ * @param buf Buffer with validated lines, either already converted by
+ * check_omils_buffer() or raw.
+ * @param n Number of lines in the buffer.
+ * @param raw Whether the buffer is raw. Its names are then converted into a
+ * separate array because the buffer is not modified.
+ * @param r The records to be filled. Their arrays are allocated in a single
+ * block, with the layout of compl_ files (see compldb_write()).
+ */
+static void index_omnils(const char *buf, int n, int raw, OmnilsRecs *r) {
+    memset(r, 0, sizeof(OmnilsRecs));
+    r->buf = buf;
+    r->nbuf = buf;
+    r->raw = raw;
+    if (n == 0)
+        return;
 
-    return NULL;
+    const char sep = raw ? '\006' : 0;
+    NamedLine *nl = malloc(n * sizeof(NamedLine));
+    size_t nsz = 0;
+    const char *s = buf;
+    for (int i = 0; i < n; i++) {
+        nl[i].line = s;
+        nl[i].name = s;
+        while (*s != sep)
+            s++;
+        nsz += s - nl[i].line + 1;
+        while (*s != '\n')
+            s++;
+        s++;
+    }
+    if (raw) {
+        char *d = r->names = malloc(nsz);
+        r->nbuf = d;
+        for (int i = 0; i < n; i++) {
+            nl[i].name = d;
+            for (s = nl[i].line; *s != '\006'; s++) {
+                if (*s == '\'')
+                    *d++ = '\x13';
+                else if (*s == '\x12')
+                    *d++ = '\'';
+                else
+                    *d++ = *s;
+            }
+            *d++ = 0;
+        }
+    }
+    qsort(nl, n, sizeof(NamedLine), compare_named_lines);
+
+    r->n = n;
+    r->arrays = malloc(compldb_arrays_size(n));
+    compldb_set_arrays(r, r->arrays, n);
+    uint32_t *name = (uint32_t *)r->name;
+    uint32_t *fld = (uint32_t *)r->fld;
+    uint16_t *nlen = (uint16_t *)r->nlen;
+    char *type = (char *)r->type;
+    uint32_t *nsep = (uint32_t *)r->nsep;
+    uint64_t *cmask = (uint64_t *)r->cmask;
+    for (int j = 0; j < n; j++) {
+        const char *nm = nl[j].name;
+        const char *f = nl[j].line;
+        for (int k = 0; k < 7; k++) {
+            while (*f != sep)
+                f++;
+            f++;
+            fld[7 * j + k] = f - buf;
+        }
+        name[j] = nm - r->nbuf;
+        size_t len = strlen(nm);
+        nlen[j] = len < UINT16_MAX ? len : UINT16_MAX;
+        type[j] = buf[fld[7 * j]];
+        nsep[j] = name_seps(nm);
+        cmask[j] = name_mask(nm);
+    }
+    free(nl);
 }
 
-void add_pkg(const char *nm, const char *vrsn) {
-    PkgData *tmp = pkgList;
-    pkgList = new_pkg_data(nm, vrsn);
-    pkgList->next = tmp;
+/**
+ * @brief Returns a field of a record. Except for the name, the field is not
+ * NULL terminated if the buffer is raw (see rec_flen()).
+ *
+ * @param r The records.
+ * @param k The record.
+ * @param i The field (0 to 6).
+ */
+static const char *rec_field(const OmnilsRecs *r, int k, int i) {
+    return i == 0 ? r->nbuf + r->name[k] : r->buf + r->fld[7 * k + i - 1];
 }
 
-// Get a string with R code, save it in a file and source the file with R.
-static int run_R_code(const char *s, int senderror) {
-    char fnm[1024];
+/**
+ * @brief Returns the length of a field of a record.
+ */
+static size_t rec_flen(const OmnilsRecs *r, int k, int i) {
+    if (i == 0)
+        return strlen(r->nbuf + r->name[k]);
+    return r->fld[7 * k + i] - r->fld[7 * k + i - 1] - 1;
+}
 
-    snprintf(fnm, 1023, "%s/bo_code.R", tmpdir);
+/**
+ * @brief Appends a field of a record to a string, converting it as
+ * check_omils_buffer() does if the buffer is raw.
+ *
+ * @param p Pointer to the end of the string.
+ * @return Pointer to the new end of the string.
+ */
+static char *cat_field(char *p, const OmnilsRecs *r, int k, int i) {
+    const char *s = rec_field(r, k, i);
+    size_t n = rec_flen(r, k, i);
+    TOUCHED(n);
+    if (r->raw && i > 0) {
+        for (size_t j = 0; j < n; j++) {
+            if (s[j] == '\'')
+                *p++ = '\x13';
+            else if (s[j] == '\x12')
+                *p++ = '\'';
+            else
+                *p++ = s[j];
+        }
+    } else {
+        memcpy(p, s, n);
+        p += n;
+    }
+    *p = 0;
+    return p;
+}
+
+/**
+ * @brief Writes the compl_ file of a package from its omnils_ file, which is
+ * mapped, validated and indexed raw.
+ *
+ * The compl_ file needs a converted copy of the omnils_ file. Since the
+ * conversion replaces bytes one by one, the offsets of the fields are the same
+ * in both, and only the names have to point to the copy.
+ */
+static void write_compldb(const PkgData *pd, const char *dbnm,
+                          const struct stat *st) {
+    char *b = malloc(pd->omnils_sz + 1);
+    memcpy(b, pd->omnils, pd->omnils_sz);
+    b[pd->omnils_sz] = 0;
+    size_t bad;
+    scan_omnils(b, pd->omnils_sz, &bad);
+
+    OmnilsRecs r = pd->recs;
+    r.buf = b;
+    r.nbuf = b;
+    r.names = NULL;
+    r.raw = 0;
+    size_t asz = compldb_arrays_size(r.n);
+    r.arrays = malloc(asz ? asz : 1);
+    memcpy(r.arrays, pd->recs.arrays, asz);
+    compldb_set_arrays(&r, r.arrays, r.n);
+    uint32_t *name = (uint32_t *)r.name;
+    for (int k = 0; k < r.n; k++)
+        name[k] = r.fld[7 * k] - rec_flen(&pd->recs, k, 0) - 1;
+
+    if (compldb_write(dbnm, st->st_size, st->st_mtime, &r, pd->omnils_sz))
+        Log("write_compldb: %s", dbnm);
+    free(r.arrays);
+    free(b);
+}
+
+/**
+ * @brief Maps the omnils_ file of a package into memory and indexes it.
+ *
+ * If the package has an up to date compl_ file, it is mapped instead, and its
+ * records are used without any parsing (see compldb.h). Otherwise, the
+ * omnils_ file is not modified: its lines are only validated, and the index
+ * keeps the offsets of their fields. Then, the pages of the file are shared by
+ * all rnvimserver instances, and the fields are converted as
+ * check_omils_buffer() does only when copied to the completion buffer (see
+ * cat_field()). Finally, the compl_ file is written for the next time.
+ */
+void load_pkg_data(PkgData *pd) {
+    Log("load_pkg_data(%s)", pd->fname);
+    ob_drop_index(&ob_libs);
+    if (!pd->descr)
+        pd->descr = get_pkg_descr(pd->name);
+    pd->nobjs = 0;
+
+    struct stat st;
+    if (stat(pd->fname, &st) != 0) {
+        fprintf(stderr, "Error opening '%s'", pd->fname);
+        fflush(stderr);
+        return;
+    }
+    char dbnm[1024];
+    snprintf(dbnm, sizeof(dbnm), "%s/compl_%s_%s", compldir, pd->name,
+             pd->version);
+    pd->omnils = map_file(dbnm, 0, &pd->omnils_sz);
+    if (pd->omnils) {
+        if (compldb_open(pd->omnils, pd->omnils_sz, st.st_size, st.st_mtime,
+                         &pd->recs)) {
+            pd->nobjs = pd->recs.n;
+            pd->loaded = 1;
+            crange_valid = 0;
+            return;
+        }
+        unmap_file(pd->omnils, pd->omnils_sz);
+    }
+
+    pd->omnils = map_file(pd->fname, 1, &pd->omnils_sz);
+    if (!pd->omnils)
+        return;
+
+    // Some packages do not export any objects.
+    long n = 0;
+    if (pd->omnils_sz > 1) {
+        size_t bad;
+        n = check_omnils_lines(pd->omnils, pd->omnils_sz, &bad);
+        if (n < 0) {
+            int len = pd->omnils_sz - bad < 16 ? pd->omnils_sz - bad : 16;
+            fprintf(stderr, "Number of separators is not 7 (%.*s)\n", len,
+                    pd->omnils + bad);
+            fflush(stderr);
+            unmap_file(pd->omnils, pd->omnils_sz);
+            pd->omnils = NULL;
+            return;
+        }
+    }
+    pd->nobjs = n;
+    pd->loaded = 1;
+    index_omnils(pd->omnils, pd->nobjs, 1, &pd->recs);
+    crange_valid = 0;
+    write_compldb(pd, dbnm, &st);
+}
+
+/**
+ * @brief Returns the position of the record of an object in the omnils_ of a
+ * package, or -1 if the package does not have it. The hash table of names is
+ * built when first needed.
+ */
+static int pkg_name_get(PkgData *pd, const char *name) {
+    if (!pd->names && pd->recs.n)
+        pd->names = new_NameHash(pd->recs.nbuf, pd->recs.name, pd->recs.n);
+    return name_hash_get(pd->names, name);
+}
+
+PkgData *new_pkg_data(const char *nm, const char *vrsn) {
+    char buf[1024];
+
+    PkgData *pd = calloc(1, sizeof(PkgData));
+    pd->name = malloc((strlen(nm) + 1) * sizeof(char));
+    strcpy(pd->name, nm);
+    pd->version = malloc((strlen(vrsn) + 1) * sizeof(char));
+    strcpy(pd->version, vrsn);
+    pd->descr = get_pkg_descr(pd->name);
+    pd->loaded = 1;
+
+    snprintf(buf, 1023, "%s/omnils_%s_%s", compldir, nm, vrsn);
+    pd->fname = malloc((strlen(buf) + 1) * sizeof(char));
+    strcpy(pd->fname, buf);
+
+    // Check if both fun_ and omnils_ exist
+    pd->built = 1;
+    if (access(buf, F_OK) != 0) {
+        pd->built = 0;
+    } else {
+        snprintf(buf, 1023, "%s/fun_%s_%s", compldir, nm, vrsn);
+        if (access(buf, F_OK) != 0)
+            pd->built = 0;
+    }
+    return pd;
+}
+
+PkgData *get_pkg(const char *nm) {
+    if (!pkgList)
+        return NULL;
+
+    PkgData *pd = pkgList;
+    do {
+        if (strcmp(pd->name, nm) == 0)
+            return pd;
+        pd = pd->next;
+    } while (pd);
+
+    return NULL;
+}
+
+void add_pkg(const char *nm, const char *vrsn) {
+    PkgData *tmp = pkgList;
+    pkgList = new_pkg_data(nm, vrsn);
+    pkgList->next = tmp;
+}
+
+#ifdef WIN32
+// Get a string with R code, save it in a file and source the file with R.
+static int run_R_code(const char *s, int senderror) {
+    char fnm[1024];
+
+    snprintf(fnm, 1023, "%s/bo_code.R", tmpdir);
     FILE *f = fopen(fnm, "w");
     if (f) {
         fwrite(s, sizeof(char), strlen(s), f);
@@ -903,7 +1445,6 @@ static int run_R_code(const char *s, int senderror) {
         return 1;
     }
 
-#ifdef WIN32
     char tdir[512];
     snprintf(tdir, 511, "%s", tmpdir);
     char *p = tdir;
@@ -1029,28 +1570,104 @@ static int run_R_code(const char *s, int senderror) {
         return 0;
     }
     return 1;
-
+}
 #else
+// Request to build cache files, sent to an R process running
+// nvim.buildhelper()
+typedef struct bol_req_ {
+    char kind;             // 'O' for omnils_ and fun_ files or 'A' for args_
+    char *pkg;             // Package name
+    char *arg;             // Package version or args_ file name
+    unsigned long seq;     // Order of arrival
+    struct bol_req_ *next; // Next pending request
+} BolReq;
+
+// R process building cache files
+typedef struct bol_worker_ {
+    FILE *f;       // Pipe with the standard output of the process
+    FILE *in;      // Pipe with its standard input, closed to let it exit
+    pid_t pid;     // Process id, which is also its process group id
+    char buf[512]; // Incomplete line read from the pipe
+    size_t len;    // Length of buf
+    BolReq *req;   // Request being processed
+    int quitting;  // The process will exit after the current request
+    int killed;    // The process was killed to cancel its request
+} BolWorker;
+
+/**
+ * @brief Starts an R process running nvimcom:::nvim.buildhelper(), with its
+ * standard input and output connected to rnvimserver through pipes.
+ *
+ * @param w The worker.
+ * @param i Number of the worker, used in the names of its files.
+ * @return 1 on success or 0 on failure.
+ */
+static int start_R_worker(BolWorker *w, int i) {
+    char fnm[512];
+    snprintf(fnm, 511, "%s/bo_code_%d.R", tmpdir, i);
+    FILE *f = fopen(fnm, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to write \"%s\"\n", fnm);
+        fflush(stderr);
+        return 0;
+    }
+    fputs("library('nvimcom')\nnvimcom:::nvim.buildhelper()\n", f);
+    fclose(f);
+
     char b[1024];
     snprintf(b, 1023,
              "RNVIM_TMPDIR=%s RNVIM_COMPLDIR=%s '%s' --quiet --no-restore "
-             "--no-save --no-echo --slave -f \"%s/bo_code.R\""
-             " > \"%s/run_R_stdout\" 2> \"%s/run_R_stderr\"",
+             "--no-save --no-echo --slave -f \"%s\" 2> \"%s/run_R_stderr_%d\"",
              getenv("RNVIM_REMOTE_TMPDIR"), getenv("RNVIM_REMOTE_COMPLDIR"),
-             getenv("RNVIM_RPATH"), tmpdir, tmpdir, tmpdir);
+             getenv("RNVIM_RPATH"), fnm, tmpdir, i);
     Log("R command: %s", b);
 
-    int stt = system(b);
-    if (stt != 0 && stt != 512) { // ssh success status seems to be 512
-        if (senderror) {
-            printf("lua require('r.server').show_bol_error('%d')\n", stt);
-            fflush(stdout);
-        }
+    int pin[2];
+    int pout[2];
+    if (pipe(pin) != 0)
+        return 0;
+    if (pipe(pout) != 0) {
+        close(pin[0]);
+        close(pin[1]);
+        return 0;
+    }
+    w->pid = fork();
+    if (w->pid == 0) {
+        // In its own process group to be killed along with the shell
+        setpgid(0, 0);
+        dup2(pin[0], STDIN_FILENO);
+        dup2(pout[1], STDOUT_FILENO);
+        close(pin[0]);
+        close(pin[1]);
+        close(pout[0]);
+        close(pout[1]);
+        execl("/bin/sh", "sh", "-c", b, (char *)NULL);
+        _exit(127);
+    }
+    close(pin[0]);
+    close(pout[1]);
+    if (w->pid < 0) {
+        close(pin[1]);
+        close(pout[0]);
+        fprintf(stderr, "Failed to start R to build cache files: %s\n",
+                strerror(errno));
+        fflush(stderr);
         return 0;
     }
+    setpgid(w->pid, w->pid);
+
+    // Other R processes must not keep the pipes open
+    fcntl(pin[1], F_SETFD, FD_CLOEXEC);
+    fcntl(pout[0], F_SETFD, FD_CLOEXEC);
+    w->in = fdopen(pin[1], "w");
+    w->f = fdopen(pout[0], "r");
+    w->len = 0;
+    w->req = NULL;
+    w->quitting = 0;
+    w->killed = 0;
     return 1;
-#endif
 }
+#endif
 
 int read_field_data(char *s, int i) {
     while (s[i]) {
@@ -1243,98 +1860,98 @@ void update_inst_libs(void) {
     }
 }
 
-static void read_args(void) {
-    if (more_to_build) {
-        has_args_to_read = 1;
-        return;
-    }
+/**
+ * @brief Maps the args_ file of a package into memory and indexes its lines
+ * by function name, if not done yet. The file is mapped only when the
+ * arguments of one of its functions are first needed.
+ *
+ * R writes the args_ files in place. So, they are not mapped while args_lock
+ * exists or the file of the package is being built, and they are unmapped
+ * when the building finishes.
+ *
+ * @return 1 if the args_ file is available or 0 if it was not built yet.
+ */
+static int map_pkg_args(PkgData *pd) {
+    if (pd->args)
+        return 1;
 
     char buf[1024];
-    PkgData *pkg = pkgList;
-    char *p;
+    struct stat st;
+    snprintf(buf, 1023, "%s/args_lock", compldir);
+    if (stat(buf, &st) == 0)
+        return 0;
+#ifndef WIN32
+    if (bol_args_pending(pd->name))
+        return 0;
+#endif
+    snprintf(buf, 1023, "%s/args_%s_%s", compldir, pd->name, pd->version);
+    pd->args = map_file(buf, 0, &pd->args_sz);
+    if (!pd->args)
+        return 0;
 
-    pkg = pkgList;
-    while (pkg) {
-        if (!pkg->args) {
-            snprintf(buf, 1023, "%s/args_%s_%s", compldir, pkg->name,
-                     pkg->version);
-            pkg->args = read_file(buf, 0);
-            if (pkg->args) {
-                p = pkg->args;
-                while (*p) {
-                    if (*p == '\006')
-                        *p = 0;
-                    p++;
-                }
-            }
-        }
-        pkg = pkg->next;
+    // Only complete lines are indexed
+    int n = 0;
+    const char *e = pd->args + pd->args_sz;
+    for (const char *p = pd->args; (p = memchr(p, '\n', e - p)); p++)
+        n++;
+    pd->argo = malloc((n + 1) * sizeof(uint32_t));
+    const char *p = pd->args;
+    for (int i = 0; i < n; i++) {
+        pd->argo[i] = p - pd->args;
+        p = memchr(p, '\n', e - p) + 1;
     }
-    has_args_to_read = 0;
+    pd->fargs = new_NameHash(pd->args, pd->argo, n);
+    return 1;
 }
 
-// Read the list of libraries loaded in R, and run another R instance to build
-// the omnils_ and fun_ files in compldir.
-static void build_omnils(void) {
-    Log("build_omnils()");
-    unsigned long nsz;
-
-    if (building_omnils) {
-        more_to_build = 1;
-        return;
-    }
-    building_omnils = 1;
-
-    char buf[1024];
-
-    memset(compl_buffer, 0, compl_buffer_size);
-    char *p = compl_buffer;
-
-    PkgData *pkg = pkgList;
-
-    // It would be easier to call R once for each library, but we will build
-    // all cache files at once to avoid the cost of starting R many times.
-    p = str_cat(p, "library('nvimcom')\np <- c(");
-    int k = 0;
-    while (pkg) {
-        if (pkg->to_build == 0) {
-            nsz = strlen(pkg->name) + 1024 + (p - compl_buffer);
-            if (compl_buffer_size < nsz)
-                p = grow_buffer(&compl_buffer, &compl_buffer_size,
-                                nsz - compl_buffer_size);
-            if (k == 0)
-                snprintf(buf, 63, "'%s'", pkg->name);
-            else
-                snprintf(buf, 63, ",\n  '%s'", pkg->name);
-            p = str_cat(p, buf);
-            pkg->to_build = 1;
-            k++;
-        }
-        pkg = pkg->next;
+#ifdef WIN32
+/**
+ * @brief Returns the R code to build the omnils_ and fun_ files of the
+ * packages. After each package, the code prints its name prefixed by '\002'.
+ */
+static char *bol_script(PkgData **pl, int k) {
+    size_t sz = 256;
+    for (int i = 0; i < k; i++)
+        sz += strlen(pl[i]->name) + 8;
+    char *s = calloc(sz, sizeof(char));
+    char *p = str_cat(s, "library('nvimcom')\np <- c(");
+    for (int i = 0; i < k; i++) {
+        if (i > 0)
+            p = str_cat(p, ",\n  ");
+        p = str_cat(p, "'");
+        p = str_cat(p, pl[i]->name);
+        p = str_cat(p, "'");
     }
+    str_cat(p, ")\nfor (x in p) {\n"
+               "    nvimcom:::nvim.buildomnils(x)\n"
+               "    cat('\\002', x, '\\n', sep = '')\n"
+               "    flush(stdout())\n"
+               "}\n");
+    return s;
+}
+#endif
 
-    if (k) {
-        // Build all the omnils_ files before beginning to build the args_
-        // files because: 1. It's about three times faster to build the
-        // omnils_ than the args_. 2. During omni completion, omnils_ is used
-        // more frequently. 3. The Object Browser only needs the omnils_.
+// Load the omni list of a package if it was built
+static void load_built_pkg(PkgData *pkg) {
+    if (pkg->built == 0 && access(pkg->fname, F_OK) == 0)
+        pkg->built = 1;
+    if (pkg->built && !pkg->omnils)
+        load_pkg_data(pkg);
+}
 
-        n_omnils_build++;
-        p = str_cat(p, ")\nnvimcom:::nvim.buildomnils(p)\n");
-        run_R_code(compl_buffer, 1);
-        finish_bol();
-    }
-    building_omnils = 0;
+static char bol_urgent[64]; // Package being completed
 
-    // If this function was called while it was running, build the remaining
-    // cache files before saving the list of libraries whose cache files were
-    // built.
-    if (more_to_build) {
-        more_to_build = 0;
-        build_omnils();
-    }
+/**
+ * @brief Gives the highest priority to the cache files of a package because
+ * the user is completing its objects or the arguments of its functions.
+ */
+static void bol_hurry(const char *pkg) {
+    snprintf(bol_urgent, sizeof(bol_urgent), "%s", pkg);
+}
 
-    // Delete args_lock if it's too old
+// Delete args_lock if it's too old
+static void check_args_lock(void) {
+    char buf[1024];
     snprintf(buf, 1023, "%s/args_lock", compldir);
     struct stat filestat;
     if ((stat(buf, &filestat) == 0)) {
@@ -1345,57 +1962,496 @@ static void build_omnils(void) {
             return;
         unlink(buf);
     }
-
-    if (has_args_to_read)
-        read_args();
 }
 
-// Called asynchronously and only if an omnils_ file was actually built.
-static void finish_bol(void) {
-    Log("finish_bol()");
+/**
+ * @brief Finishes the building of omni lists: if build_omnils() was called
+ * while it was running, builds the remaining cache files.
+ */
+static void end_build_omnils(void) {
+    building_omnils = 0;
+    if (more_to_build) {
+        more_to_build = 0;
+        build_omnils();
+    }
+    check_args_lock();
+}
 
-    char buf[1024];
+#ifndef WIN32
+// The cache files are built by up to build_workers R processes, each one
+// running nvim.buildhelper(), which reads requests from its standard input.
+// The requests wait in bol_queue and each free process gets the most urgent
+// one (see bol_priority()). The processes exit when there are no more
+// requests, except the first one, if build_helper is set.
+
+static BolWorker *bol_wk;     // R processes building cache files
+static BolReq *bol_queue;     // Pending requests
+static unsigned long bol_seq; // Number of requests received
+static int bol_omnils;        // Unfinished requests for omnils_ files
+static int bol_args;          // Unfinished requests for args_ files
+static int bol_finish;        // finish_bol() is due when bol_omnils is 0
+static int bol_args_lock;     // args_lock is deleted when bol_args is 0
+static char *buf_libs;        // Packages referenced in the buffers being
+                              // edited, each one between '\002'
+
+static int in_buf_libs(const char *pkg) {
+    if (!buf_libs)
+        return 0;
+    char b[72];
+    snprintf(b, 71, "\002%s\002", pkg);
+    return strstr(buf_libs, b) != NULL;
+}
 
-    // Don't check the return value of run_R_code because some packages might
-    // have been successfully built before R exiting with status > 0.
+/**
+ * @brief Sets the list of packages referenced in the buffers being edited.
+ *
+ * @param s Package names separated by '\002'.
+ */
+static void set_buf_libs(const char *s) {
+    free(buf_libs);
+    buf_libs = malloc(strlen(s) + 3);
+    sprintf(buf_libs, "\002%s\002", s);
+}
 
-    // Check if all files were really built before trying to load them.
-    PkgData *pkg = pkgList;
-    while (pkg) {
-        if (pkg->built == 0 && access(pkg->fname, F_OK) == 0)
-            pkg->built = 1;
-        if (pkg->built && !pkg->omnils)
-            load_pkg_data(pkg);
-        pkg = pkg->next;
-    }
+/**
+ * @brief Returns the priority of a request (lower is more urgent): first the
+ * package being completed, then the packages referenced in the buffers being
+ * edited, and then the other ones. The args_ files come after all omnils_
+ * files, except those of the package being completed.
+ */
+static int bol_priority(const BolReq *r) {
+    if (strcmp(r->pkg, bol_urgent) == 0)
+        return r->kind == 'O' ? 0 : 1;
+    int p = in_buf_libs(r->pkg) ? 2 : 3;
+    if (r->kind == 'A')
+        p += 2;
+    return p;
+}
 
-    // Finally create a list of built omnils_ because libnames_ might have
-    // already changed and Nvim-R would try to read omnils_ files not built yet.
-    snprintf(buf, 511, "%s/libs_in_nrs_%s", localtmpdir, getenv("RNVIM_ID"));
-    FILE *f = fopen(buf, "w");
-    if (f) {
-        PkgData *pkg = pkgList;
-        while (pkg) {
-            if (pkg->loaded && pkg->built && pkg->omnils)
-                fprintf(f, "%s_%s\n", pkg->name, pkg->version);
-            pkg = pkg->next;
+// Remove the most urgent request from the queue. Among requests of the same
+// priority, the last one received, usually of the last package loaded, wins.
+static BolReq *bol_pick(void) {
+    BolReq **best = NULL;
+    int bp = 0;
+    for (BolReq **r = &bol_queue; *r; r = &(*r)->next) {
+        int p = bol_priority(*r);
+        if (!best || p < bp || (p == bp && (*r)->seq > (*best)->seq)) {
+            best = r;
+            bp = p;
         }
-        fclose(f);
     }
+    if (!best)
+        return NULL;
+    BolReq *r = *best;
+    *best = r->next;
+    r->next = NULL;
+    return r;
+}
 
-    // Message to Neovim: Update both syntax and Rhelp_list
-    printf("lua require('r.server').update_Rhelp_list()\n");
-    fflush(stdout);
+static int bol_args_pending(const char *pkg) {
+    for (BolReq *r = bol_queue; r; r = r->next)
+        if (r->kind == 'A' && strcmp(r->pkg, pkg) == 0)
+            return 1;
+    for (int i = 0; bol_wk && i < build_workers; i++)
+        if (bol_wk[i].req && bol_wk[i].req->kind == 'A' &&
+            strcmp(bol_wk[i].req->pkg, pkg) == 0)
+            return 1;
+    return 0;
 }
 
-// Read the DESCRIPTION of all installed libraries
-char *complete_instlibs(char *p, const char *base) {
-    update_inst_libs();
+static int same_req(const BolReq *r, char kind, const char *pkg,
+                    const char *arg) {
+    return r && r->kind == kind && strcmp(r->pkg, pkg) == 0 &&
+           strcmp(r->arg, arg) == 0;
+}
 
-    if (!instlibs)
-        return p;
+/**
+ * @brief Adds a request to the queue, unless it is already pending.
+ *
+ * @param kind 'O' to build the omnils_ and fun_ files or 'A' for the args_.
+ * @param pkg Package name.
+ * @param arg Package version or args_ file name.
+ */
+static void bol_push(char kind, const char *pkg, const char *arg) {
+    for (BolReq *r = bol_queue; r; r = r->next)
+        if (same_req(r, kind, pkg, arg))
+            return;
+    for (int i = 0; bol_wk && i < build_workers; i++)
+        if (!bol_wk[i].killed && same_req(bol_wk[i].req, kind, pkg, arg))
+            return;
 
-    unsigned long len;
+    BolReq *r = calloc(1, sizeof(BolReq));
+    r->kind = kind;
+    r->pkg = malloc(strlen(pkg) + 1);
+    strcpy(r->pkg, pkg);
+    r->arg = malloc(strlen(arg) + 1);
+    strcpy(r->arg, arg);
+    r->seq = ++bol_seq;
+    r->next = bol_queue;
+    bol_queue = r;
+    if (kind == 'O')
+        bol_omnils++;
+    else
+        bol_args++;
+}
+
+static void bol_free(BolReq *r) {
+    free(r->pkg);
+    free(r->arg);
+    free(r);
+}
+
+// Remove a request from the count of unfinished requests and free it
+static void bol_done(BolReq *r) {
+    if (r->kind == 'O')
+        bol_omnils--;
+    else
+        bol_args--;
+    bol_free(r);
+}
+
+/**
+ * @brief Finishes the building of omni lists and args_ files if all
+ * requests of each kind were finished.
+ */
+static void bol_check_done(void) {
+    if (bol_args == 0 && bol_args_lock) {
+        bol_args_lock = 0;
+        char buf[1024];
+        snprintf(buf, 1023, "%s/args_lock", compldir);
+        unlink(buf);
+    }
+    if (bol_omnils == 0 && building_omnils) {
+        if (bol_finish) {
+            bol_finish = 0;
+            finish_bol();
+        }
+        end_build_omnils();
+    }
+}
+
+/**
+ * @brief Sends the most urgent requests to the R processes that are not
+ * processing any, starting them as needed. Idle processes are let exit. If no
+ * R process can be started, the pending requests are dropped.
+ */
+static void bol_dispatch(void) {
+    if (!bol_wk)
+        bol_wk = calloc(build_workers, sizeof(BolWorker));
+
+    for (int i = 0; i < build_workers; i++) {
+        BolWorker *w = bol_wk + i;
+        if (w->req || (w->f && (w->quitting || !w->in)))
+            continue;
+        if (!bol_queue) {
+            if (w->in && !(build_helper && i == 0)) {
+                fclose(w->in);
+                w->in = NULL;
+            }
+            continue;
+        }
+        if (!w->f && !start_R_worker(w, i)) {
+            int running = 0;
+            for (int j = 0; j < build_workers; j++)
+                if (bol_wk[j].f)
+                    running = 1;
+            while (!running && bol_queue) {
+                BolReq *r = bol_queue;
+                bol_queue = r->next;
+                bol_done(r);
+            }
+            break;
+        }
+
+        w->req = bol_pick();
+        // If R has just exited, bol_worker_event() will know it
+        void (*h)(int) = signal(SIGPIPE, SIG_IGN);
+        if (w->req->kind == 'O')
+            fprintf(w->in, "O\t%s\n", w->req->pkg);
+        else
+            fprintf(w->in, "A\t%s\t%s\n", w->req->arg, w->req->pkg);
+        fflush(w->in);
+        signal(SIGPIPE, h);
+    }
+}
+
+/**
+ * @brief Cancels the building of the omni list of a package that was
+ * unloaded. If an R process is building it, the process is killed.
+ */
+static void bol_cancel(const PkgData *pkg) {
+    BolReq **r = &bol_queue;
+    while (*r) {
+        if ((*r)->kind == 'O' && strcmp((*r)->pkg, pkg->name) == 0) {
+            BolReq *c = *r;
+            *r = c->next;
+            bol_done(c);
+        } else {
+            r = &(*r)->next;
+        }
+    }
+
+    // The incomplete files are deleted when the process exits
+    for (int i = 0; bol_wk && i < build_workers; i++) {
+        BolWorker *w = bol_wk + i;
+        if (w->req && !w->killed && w->req->kind == 'O' &&
+            strcmp(w->req->pkg, pkg->name) == 0) {
+            Log("bol_cancel(%s): killing %d", pkg->name, (int)w->pid);
+            kill(-w->pid, SIGTERM);
+            w->killed = 1;
+            bol_omnils--;
+        }
+    }
+}
+
+/**
+ * @brief Reads the output of a worker. Lines beginning with '\002' or '\003'
+ * mean that the omni list of a package or an args_ file was built, and a line
+ * with '\004' means that the process will exit after its current request.
+ *
+ * @return 0 if the worker has closed its output and 1 otherwise.
+ */
+static int read_bol_worker(BolWorker *w) {
+    ssize_t n =
+        read(fileno(w->f), w->buf + w->len, sizeof(w->buf) - 1 - w->len);
+    if (n <= 0)
+        return 0;
+    w->len += n;
+    w->buf[w->len] = 0;
+
+    char *s = w->buf;
+    char *e;
+    while ((e = memchr(s, '\n', w->len - (s - w->buf)))) {
+        *e = 0;
+        if (*s == '\004') {
+            w->quitting = 1;
+        } else if ((*s == '\002' || *s == '\003') && w->req && !w->killed) {
+            if (*s == '\002') {
+                PkgData *pkg = get_pkg(s + 1);
+                if (pkg)
+                    finish_pkg_bol(pkg);
+            } else if (w->req->kind == 'A') {
+                // Forget any partial args_ file mapped during the building
+                PkgData *pkg = get_pkg(w->req->pkg);
+                if (pkg)
+                    unmap_pkg_args(pkg);
+            }
+            bol_done(w->req);
+            w->req = NULL;
+        }
+        s = e + 1;
+    }
+    w->len -= s - w->buf;
+    memmove(w->buf, s, w->len);
+
+    // Other output of R, such as messages, is not needed
+    if (w->len == sizeof(w->buf) - 1)
+        w->len = 0;
+    return 1;
+}
+
+/**
+ * @brief Handles data or the end of the output of a worker, and sends the
+ * next requests.
+ *
+ * A worker exits when there are no more requests for it, or by itself when
+ * the memory used by R grows too much, after announcing it. If it exits while
+ * processing a request, this request is dropped and the error is reported.
+ *
+ * @param i The worker.
+ */
+static void bol_worker_event(int i) {
+    BolWorker *w = bol_wk + i;
+    if (!read_bol_worker(w)) {
+        fclose(w->f);
+        w->f = NULL;
+        if (w->in) {
+            fclose(w->in);
+            w->in = NULL;
+        }
+        int stt = 0;
+        waitpid(w->pid, &stt, 0);
+        Log("R process %d exited: %d", i, stt);
+
+        char fnm[1024];
+        char efnm[1024];
+        snprintf(fnm, 1023, "%s/bo_code_%d.R", tmpdir, i);
+        unlink(fnm);
+        snprintf(fnm, 1023, "%s/run_R_stderr_%d", tmpdir, i);
+        if (w->req && !w->killed) {
+            snprintf(efnm, 1023, "%s/run_R_stderr", tmpdir);
+            rename(fnm, efnm);
+            printf("lua require('r.server').show_bol_error('%d')\n", stt);
+            fflush(stdout);
+            bol_done(w->req);
+        } else {
+            unlink(fnm);
+        }
+        if (w->req && w->killed) {
+            snprintf(fnm, 1023, "%s/omnils_%s_%s", compldir, w->req->pkg,
+                     w->req->arg);
+            unlink(fnm);
+            snprintf(fnm, 1023, "%s/fun_%s_%s", compldir, w->req->pkg,
+                     w->req->arg);
+            unlink(fnm);
+            bol_free(w->req);
+        }
+        w->req = NULL;
+        w->killed = 0;
+    }
+    bol_dispatch();
+    bol_check_done();
+}
+
+/**
+ * @brief Queues the building of args_ files. The args_lock file, created by
+ * R.nvim, is deleted after the last one is built.
+ *
+ * @param s The args_ files, separated by '\002', each one followed by a tab
+ * and the name of its package.
+ */
+static void build_args(char *s) {
+    char *p;
+    char *t;
+    while (*s) {
+        p = strchr(s, '\002');
+        if (p)
+            *p = 0;
+        t = strchr(s, '\t');
+        if (t) {
+            *t = 0;
+            bol_push('A', t + 1, s);
+        }
+        if (!p)
+            break;
+        s = p + 1;
+    }
+    bol_args_lock = 1;
+    bol_dispatch();
+    bol_check_done();
+}
+#endif
+
+// Read the list of libraries loaded in R, and run other R instances to build
+// the omnils_ and fun_ files in compldir. On Unix, the R processes run in the
+// background, and the building is finished by bol_check_done().
+static void build_omnils(void) {
+    Log("build_omnils()");
+
+#ifdef WIN32
+    if (building_omnils) {
+        more_to_build = 1;
+        return;
+    }
+#endif
+    building_omnils = 1;
+
+    int k = 0;
+    for (PkgData *pkg = pkgList; pkg; pkg = pkg->next)
+        if (pkg->to_build == 0)
+            k++;
+    PkgData **pl = malloc((k + 1) * sizeof(PkgData *));
+    k = 0;
+    for (PkgData *pkg = pkgList; pkg; pkg = pkg->next) {
+        if (pkg->to_build == 0) {
+            pl[k++] = pkg;
+            pkg->to_build = 1;
+        }
+    }
+
+    if (k) {
+        // Build all the omnils_ files before beginning to build the args_
+        // files because: 1. It's about three times faster to build the
+        // omnils_ than the args_. 2. During omni completion, omnils_ is used
+        // more frequently. 3. The Object Browser only needs the omnils_.
+        n_omnils_build++;
+#ifdef WIN32
+        char *s = bol_script(pl, k);
+        run_R_code(s, 1);
+        free(s);
+        finish_bol();
+#else
+        // The packages referenced in the buffers are built first
+        printf("lua require('r.server').send_buf_libs()\n");
+        fflush(stdout);
+        for (int i = k - 1; i >= 0; i--)
+            bol_push('O', pl[i]->name, pl[i]->version);
+        bol_finish = 1;
+        bol_dispatch();
+#endif
+    }
+    free(pl);
+
+#ifdef WIN32
+    end_build_omnils();
+#else
+    bol_check_done();
+#endif
+}
+
+// Write the list of packages whose omnils_ were built and loaded because
+// libnames_ might have already changed and Nvim-R would try to read omnils_
+// files not built yet.
+static void write_libs_in_nrs(void) {
+    char buf[512];
+    snprintf(buf, 511, "%s/libs_in_nrs_%s", localtmpdir, getenv("RNVIM_ID"));
+    FILE *f = fopen(buf, "w");
+    if (f) {
+        PkgData *pkg = pkgList;
+        while (pkg) {
+            if (pkg->loaded && pkg->built && pkg->omnils)
+                fprintf(f, "%s_%s\n", pkg->name, pkg->version);
+            pkg = pkg->next;
+        }
+        fclose(f);
+    }
+}
+
+/**
+ * @brief Loads the omni list of a package as soon as it is built, while other
+ * packages are still being built, and updates the list of loaded packages and
+ * the Object Browser.
+ */
+static void finish_pkg_bol(PkgData *pkg) {
+    if (pkg->omnils)
+        return;
+    load_built_pkg(pkg);
+    if (!pkg->omnils)
+        return;
+    write_libs_in_nrs();
+    if (auto_obbr)
+        lib2ob();
+}
+
+static void finish_bol(void) {
+    Log("finish_bol()");
+
+    // Don't check the return value of run_R_code because some packages might
+    // have been successfully built before R exiting with status > 0.
+
+    // Check if all files were really built before trying to load them.
+    // Most of them were already loaded by finish_pkg_bol().
+    PkgData *pkg = pkgList;
+    while (pkg) {
+        load_built_pkg(pkg);
+        pkg = pkg->next;
+    }
+
+    write_libs_in_nrs();
+
+    // Message to Neovim: Update both syntax and Rhelp_list
+    printf("lua require('r.server').update_Rhelp_list()\n");
+    fflush(stdout);
+}
+
+// Read the DESCRIPTION of all installed libraries
+char *complete_instlibs(char *p, const char *base) {
+    update_inst_libs();
+
+    if (!instlibs)
+        return p;
+
+    unsigned long len;
     InstLibs *il;
 
     il = instlibs;
@@ -1498,6 +2554,13 @@ void update_pkg_list(char *libnms) {
     if (!pkgList)
         return;
 
+#ifndef WIN32
+    // Stop building the omni lists of unloaded packages
+    for (pkg = pkgList; pkg; pkg = pkg->next)
+        if (pkg->loaded == 0 && pkg->to_build && !pkg->omnils)
+            bol_cancel(pkg);
+#endif
+
     // Delete data from unloaded packages to ensure that reloaded packages go
     // to the bottom of the Object Browser list
     pkg = pkgList;
@@ -1520,6 +2583,33 @@ void update_pkg_list(char *libnms) {
     }
 }
 
+/**
+ * @brief Saves the status of the lists in the obstatus_ file of the project
+ * if any of them was opened or closed. Called at exit.
+ */
+static void save_list_status(void) {
+    if (list_status_changed && obstatus_fname[0])
+        obstatus_save(listTree, obstatus_fname, project_dir);
+}
+
+/**
+ * @brief Reads the status of the lists saved in the previous sessions in the
+ * same project, when it is first needed, that is, when the Object Browser is
+ * first rendered.
+ */
+static void load_list_status(void) {
+    if (list_status_loaded)
+        return;
+    list_status_loaded = 1;
+    if (!getcwd(project_dir, sizeof(project_dir)))
+        return;
+    snprintf(obstatus_fname, sizeof(obstatus_fname), "%s/obstatus_%016llx",
+             compldir, (unsigned long long)obstatus_hash(project_dir));
+    int n = obstatus_load(listTree, obstatus_fname, project_dir);
+    Log("load_list_status: %d lists in '%s'", n, obstatus_fname);
+    atexit(save_list_status);
+}
+
 /**
  * TODO: Candidate for data_structures.c
  *
@@ -1529,10 +2619,11 @@ void update_pkg_list(char *libnms) {
  * @return
  */
 int get_list_status(const char *s, int stt) {
-    ListStatus *p = search(listTree, s);
+    load_list_status();
+    ListStatus *p = list_status_get(listTree, s);
     if (p)
         return p->status;
-    insert(listTree, s, stt);
+    list_status_add(listTree, s, stt);
     return stt;
 }
 
@@ -1543,23 +2634,262 @@ int get_list_status(const char *s, int stt) {
  * @param s:
  */
 void toggle_list_status(const char *s) {
-    ListStatus *p = search(listTree, s);
-    if (p)
+    load_list_status();
+    ListStatus *p = list_status_get(listTree, s);
+    if (p) {
         p->status = !p->status;
+        p->user = 1;
+        list_status_changed = 1;
+    }
+}
+
+/**
+ * @brief Sends the paths accumulated by request_expansion() to nvimcom.
+ */
+static void flush_expansions(void) {
+    if (exp_msg[0] && exp_msg[strlen(exp_msg) - 1] == '\n')
+        send_to_nvimcom(exp_msg);
+    exp_msg[0] = 0;
+}
+
+/**
+ * @brief Asks nvimcom to list the elements of a list or S4 object.
+ *
+ * nvimcom lists only the top level objects of .GlobalEnv, and the elements
+ * of objects that were expanded. Each path is requested only once for each
+ * connection with nvimcom. The paths are accumulated in exp_msg and sent by
+ * flush_expansions(), in as many messages as needed.
+ *
+ * @param path Name of the object including its parents (e.g. "alist$aS4@x").
+ */
+static void request_expansion(const char *path) {
+    if (!r_conn)
+        return;
+    size_t plen = strlen(path);
+    // A path too long for a message by itself is never requested
+    if (plen + strlen(getenv("RNVIM_ID")) + 3 > sizeof(exp_msg))
+        return;
+    if (!expTree)
+        expTree = new_ListStatusTable();
+    ListStatus *p = list_status_get(expTree, path);
+    if (p) {
+        if (p->status == nvimcom_session)
+            return;
+        p->status = nvimcom_session;
+    } else {
+        list_status_add(expTree, path, nvimcom_session);
+    }
+    if (strlen(exp_msg) + plen + 2 > sizeof(exp_msg))
+        flush_expansions();
+    if (exp_msg[0] == 0)
+        snprintf(exp_msg, 64, "X%s", getenv("RNVIM_ID"));
+    strcat(exp_msg, path);
+    strcat(exp_msg, "\n");
+}
+
+/**
+ * @brief Requests the expansion of the object being completed if `base` refers
+ * to an element of a .GlobalEnv list or S4 object (e.g. "alist$el").
+ *
+ * The elements will be available in the next completion after nvimcom sends
+ * the updated list of objects.
+ *
+ * @param base The completion base.
+ */
+static void expand_completion_base(const char *base) {
+    char path[512];
+    const char *e = NULL;
+    const char *s;
+    for (s = base; *s; s++)
+        if (*s == '$' || *s == '@' || (s[0] == '[' && s[1] == '['))
+            e = s;
+    if (!e || e == base || (e - base) > 510 || !glbnv_buffer)
+        return;
+    // The top level object must exist
+    for (s = base; s < e && *s != '$' && *s != '@' && *s != '['; s++)
+        ;
+    memcpy(path, base, s - base);
+    path[s - base] = 0;
+    if (find_glbnv_block(path, 0) < 0)
+        return;
+    memcpy(path, base, e - base);
+    path[e - base] = 0;
+    request_expansion(path);
+}
+
+/**
+ * @brief Appends formatted text to the rendering of a view of the Object
+ * Browser, as fprintf() would do to a file.
+ */
+static void ob_printf(ObText *t, const char *fmt, ...) {
+    va_list ap;
+    for (;;) {
+        if (t->sz - t->len >= 512) {
+            va_start(ap, fmt);
+            int n = vsnprintf(t->b + t->len, t->sz - t->len, fmt, ap);
+            va_end(ap);
+            // The Windows C library returns -1 if the text does not fit
+            if (n >= 0 && (size_t)n < t->sz - t->len) {
+                t->len += n;
+                return;
+            }
+        }
+        size_t sz = t->sz ? 2 * t->sz : 65536;
+        char *b = realloc(t->b, sz);
+        if (!b) {
+            if (t->b)
+                t->b[t->len] = 0;
+            return;
+        }
+        t->b = b;
+        t->sz = sz;
+    }
+}
+
+/**
+ * @brief Adds a line to the index of a view of the Object Browser.
+ *
+ * @param name Name of the object, library or text of a header line.
+ * @param descr Description of the object.
+ * @param type Type of the object, as in the omnils_ lines, or 0 for header
+ * lines.
+ * @param raw Whether name and descr must be displayed as they are.
+ * @param prfx Prefix of the line.
+ * @param parent Line of the parent object or -1.
+ * @return The number of the line in the view.
+ */
+static long ob_add_line(ObIndex *ix, const char *name, const char *descr,
+                        char type, int raw, const char *prfx, long parent) {
+    if (ix->n == ix->sz) {
+        ix->sz = ix->sz ? 2 * ix->sz : 4096;
+        ix->l = realloc(ix->l, ix->sz * sizeof(ObLine));
+    }
+    // Lines of the same list share the prefix
+    if (ix->n == 0 || strcmp(ix->prfx.b + ix->l[ix->n - 1].prfx, prfx)) {
+        ix->lastprfx = ix->prfx.len;
+        ob_printf(&ix->prfx, "%s%c", prfx, 0);
+    }
+    ObLine *l = ix->l + ix->n;
+    l->name = name;
+    l->descr = descr;
+    l->type = type;
+    l->raw = raw;
+    l->prfx = ix->lastprfx;
+    l->parent = parent;
+    return ix->n++;
+}
+
+static void ob_index_init(ObIndex *ix, const char *header) {
+    memset(ix, 0, sizeof(ObIndex));
+    ob_add_line(ix, header, "", 0, 1, "", -1);
+    ob_add_line(ix, "", "", 0, 1, "", -1);
+}
+
+static void ob_index_free(ObIndex *ix) {
+    free(ix->l);
+    free(ix->prfx.b);
+    memset(ix, 0, sizeof(ObIndex));
+}
+
+/**
+ * @brief Forgets the index of a view of the Object Browser, whose lines point
+ * to data that is about to change. The index is built again by omni2ob() or
+ * lib2ob() when needed.
+ */
+static void ob_drop_index(ObView *v) { ob_index_free(&v->ix); }
+
+/**
+ * @brief Appends a line of the index of the Object Browser to the text of the
+ * view, followed by a NULL byte.
+ *
+ * The name and the description may be fields of a raw omnils_ line,
+ * terminated by '\006' (see index_ob_line()). Their quotes are then displayed
+ * as check_omils_buffer() would convert them.
+ */
+static void ob_format_line(ObText *t, const ObLine *l, const char *prfx) {
+    char nm[160];
+    char descr[160];
+    const char *s;
+    int i;
+
+    if (l->type == 0) {
+        ob_printf(t, "%s%c", l->name, 0);
+        return;
+    }
+    if (l->raw) {
+        ob_printf(t, "   %s%c#%s\t%s%c", prfx, l->type, l->name, l->descr, 0);
+        return;
+    }
+
+    // Replace \x13 (or \x12 in raw lines) with single quote
+    i = 0;
+    s = l->name;
+    while (s[i] && s[i] != '\006' && i < 159) {
+        if (s[i] == '\x13' || s[i] == '\x12')
+            nm[i] = '\'';
+        else
+            nm[i] = s[i];
+        i++;
+    }
+    nm[i] = 0;
+
+    // Replace \x13 (or \x12 in raw lines) with single quote
+    i = 0;
+    s = l->descr;
+    while (s[i] && s[i] != '\006' && i < 159) {
+        if (s[i] == '\x13' || s[i] == '\x12')
+            descr[i] = '\'';
+        else
+            descr[i] = s[i];
+        i++;
+    }
+    descr[i] = 0;
+
+    ob_printf(t, "   %s%c#%s\t%s%c", prfx, l->type, nm, descr, 0);
+}
+
+// Is the line at p an element of the list whose names begin with b1 or b2?
+// The lines end at end, or at a NULL byte if end is NULL.
+static int ob_element_here(const char *p, const char *end, const char *b1,
+                           const char *b2) {
+    if (end ? p >= end : *p == 0)
+        return 0;
+    return str_here(p, b1) || str_here(p, b2);
 }
 
-static const char *write_ob_line(const char *p, const char *bs, char *prfx,
-                                 int closeddf, FILE *fl) {
+/**
+ * @brief Adds an object and its visible elements to the index of a view of
+ * the Object Browser.
+ *
+ * The lines are either converted by check_omils_buffer() or, if pd is not
+ * NULL, the raw lines of its mapped omnils_ file, which are not copied. Their
+ * fields end with '\006' and are converted by ob_format_line() when
+ * displayed, and the keys of the lists are their converted names in
+ * pd->recs.nbuf.
+ *
+ * @param p The object in the omnils_ lines.
+ * @param end End of the last raw line or NULL if the lines are converted.
+ * @param bs Name of the parent list, data.frame or S4 object, with '$' or '@'.
+ * @param prfx Prefix of the line, with the lines of the tree.
+ * @param closeddf Ignore the objbr_opendf and objbr_openlist options.
+ * @param parent Line of the parent object in the view or -1.
+ * @param ix The index.
+ * @param pd The package whose raw lines are indexed or NULL.
+ * @return Pointer to the line following the object and its elements.
+ */
+static const char *index_ob_line(const char *p, const char *end,
+                                 const char *bs, char *prfx, int closeddf,
+                                 long parent, ObIndex *ix, PkgData *pd) {
     char base1[128];
     char base2[128];
     char prefix[128];
     char newprfx[96];
-    char nm[160];
-    char descr[160];
     const char *f[7];
     const char *s;    // Diagnostic pointer
     const char *bsnm; // Name of object including its parent list, data.frame or
                       // S4 object
+    const char *line = p;
+    const char sep = pd ? '\006' : 0;
     int df;           // Is data.frame? If yes, start open unless closeddf = 1
     int i;
     int ne;
@@ -1573,63 +2903,54 @@ static const char *write_ob_line(const char *p, const char *bs, char *prfx,
     while (i < 7) {
         f[i] = p;
         i++;
-        while (*p != 0)
+        while (*p != sep)
             p++;
         p++;
     }
-    while (*p != '\n' && *p != 0)
+    while (p != end && *p != '\n' && *p != 0)
         p++;
-    if (*p == '\n')
+    if (p != end && *p == '\n')
         p++;
 
-    if (closeddf)
-        df = 0;
+    // The lines of the elements begin with the name as it is in the line. If
+    // the line is raw, the key of a list is its converted name.
+    int nlen = f[1] - line - 1;
+    char t = f[1][0];
+    if (pd && (t == '[' || t == '$' || t == '<' || t == ':')) {
+        char nm[1024];
+        int k = -1;
+        if (nlen < (int)sizeof(nm)) {
+            for (i = 0; i < nlen; i++) {
+                if (line[i] == '\'')
+                    nm[i] = '\x13';
+                else if (line[i] == '\x12')
+                    nm[i] = '\'';
+                else
+                    nm[i] = line[i];
+            }
+            nm[nlen] = 0;
+            k = pkg_name_get(pd, nm);
+        }
+        if (k < 0)
+            return p; // Not indexed by index_omnils()
+        bsnm = pd->recs.nbuf + pd->recs.name[k];
+    }
+
+    if (closeddf)
+        df = 0;
     else if (f[1][0] == '$')
         df = OpenDF;
     else
         df = OpenLS;
 
-    // Replace \x13 with single quote
-    i = 0;
-    s = f[0];
-    while (s[i] && i < 159) {
-        if (s[i] == '\x13')
-            nm[i] = '\'';
-        else
-            nm[i] = s[i];
-        i++;
-    }
-    nm[i] = 0;
-
-    // Replace \x13 with single quote
-    if (f[1][0] == '\003')
-        s = f[5];
-    else
-        s = f[6];
-    if (s[0] == 0) {
-        descr[0] = 0;
-    } else {
-        i = 0;
-        while (s[i] && i < 159) {
-            if (s[i] == '\x13')
-                descr[i] = '\'';
-            else
-                descr[i] = s[i];
-            i++;
-        }
-        descr[i] = 0;
-    }
-
+    long ln = parent;
     if (!(bsnm[0] == '.' && allnames == 0)) {
         if (f[1][0] == '\003')
-            fprintf(fl, "   %s(#%s\t%s\n", prfx, nm, descr);
+            ln = ob_add_line(ix, f[0], f[5], '(', 0, prfx, parent);
         else
-            fprintf(fl, "   %s%c#%s\t%s\n", prfx, f[1][0], nm, descr);
+            ln = ob_add_line(ix, f[0], f[6], f[1][0], 0, prfx, parent);
     }
 
-    if (*p == 0)
-        return p;
-
     if (f[1][0] == '[' || f[1][0] == '$' || f[1][0] == '<' || f[1][0] == ':') {
         s = f[6];
         s++;
@@ -1642,17 +2963,23 @@ static const char *write_ob_line(const char *p, const char *bs, char *prfx,
         }
         ne = atoi(s);
         if (f[1][0] == '[' || f[1][0] == '$' || f[1][0] == ':') {
-            snprintf(base1, 127, "%s$", bsnm);  // Named list
-            snprintf(base2, 127, "%s[[", bsnm); // Unnamed list
+            snprintf(base1, 127, "%.*s$", nlen, line);  // Named list
+            snprintf(base2, 127, "%.*s[[", nlen, line); // Unnamed list
         } else {
-            snprintf(base1, 127, "%s@", bsnm); // S4 object
-            snprintf(
-                base2, 127, "%s[[",
-                bsnm); // S4 object always have names but base2 must be defined
+            snprintf(base1, 127, "%.*s@", nlen, line); // S4 object
+            snprintf(base2, 127, "%.*s[[", nlen,
+                     line); // S4 object always have names but base2 must be
+                            // defined
         }
 
+        // nvimcom only lists the elements of expanded objects
+        if (f[1][0] != ':' && !pd && strcmp(f[3], ".GlobalEnv") == 0 &&
+            !ob_element_here(p, end, base1, base2) &&
+            get_list_status(bsnm, df) == 1)
+            request_expansion(bsnm);
+
         if (get_list_status(bsnm, df) == 0) {
-            while (str_here(p, base1) || str_here(p, base2)) {
+            while (ob_element_here(p, end, base1, base2)) {
                 while (*p != '\n')
                     p++;
                 p++;
@@ -1661,7 +2988,7 @@ static const char *write_ob_line(const char *p, const char *bs, char *prfx,
             return p;
         }
 
-        if (str_here(p, base1) == 0 && str_here(p, base2) == 0)
+        if (!ob_element_here(p, end, base1, base2))
             return p;
 
         int len = strlen(prfx);
@@ -1698,7 +3025,7 @@ static const char *write_ob_line(const char *p, const char *bs, char *prfx,
         }
 
         // Check if the next list element really is there
-        while (str_here(p, base1) || str_here(p, base2)) {
+        while (ob_element_here(p, end, base1, base2)) {
             // Check if this is the last element in the list
             s = p;
             while (*s != '\n')
@@ -1708,23 +3035,87 @@ static const char *write_ob_line(const char *p, const char *bs, char *prfx,
             if (ne == 0) {
                 snprintf(prefix, 112, "%s%s", newprfx, strL);
             } else {
-                if (str_here(s, base1) || str_here(s, base2))
+                if (ob_element_here(s, end, base1, base2))
                     snprintf(prefix, 112, "%s%s", newprfx, strT);
                 else
                     snprintf(prefix, 112, "%s%s", newprfx, strL);
             }
 
-            if (*p) {
-                if (str_here(p, base1))
-                    p = write_ob_line(p, base1, prefix, 0, fl);
-                else
-                    p = write_ob_line(p, bsnm, prefix, 0, fl);
-            }
+            if (str_here(p, base1))
+                p = index_ob_line(p, end, base1, prefix, 0, ln, ix, pd);
+            else
+                p = index_ob_line(p, end, bsnm, prefix, 0, ln, ix, pd);
         }
     }
     return p;
 }
 
+static void add_glbnv_block(GlbnvBlock **blk, int *n, int *sz, size_t start,
+                            size_t len) {
+    if (*n == *sz) {
+        *sz += 256;
+        *blk = realloc(*blk, *sz * sizeof(GlbnvBlock));
+    }
+    (*blk)[*n].start = start;
+    (*blk)[*n].len = len;
+    (*n)++;
+}
+
+/**
+ * @brief Splits the glbnv_buffer in blocks, one for each object in
+ * .GlobalEnv.
+ *
+ * The lines describing the elements of a list or S4 object follow the line of
+ * their parent, and their names begin with the parent's name followed by `$`,
+ * `@` or `[`.
+ */
+static void index_glblenv_buffer(void) {
+    glbnv_nblk = 0;
+    const char *s = glbnv_buffer;
+    const char *top = NULL;
+    size_t toplen = 0;
+    while (*s) {
+        if (!(top && strncmp(s, top, toplen) == 0 &&
+              (s[toplen] == '$' || s[toplen] == '@' || s[toplen] == '['))) {
+            if (top)
+                glbnv_blk[glbnv_nblk - 1].len =
+                    (s - glbnv_buffer) - glbnv_blk[glbnv_nblk - 1].start;
+            top = s;
+            toplen = strlen(s);
+            add_glbnv_block(&glbnv_blk, &glbnv_nblk, &glbnv_blk_sz,
+                            s - glbnv_buffer, 0);
+        }
+        while (*s != '\n')
+            s++;
+        s++;
+    }
+    if (top)
+        glbnv_blk[glbnv_nblk - 1].len =
+            (s - glbnv_buffer) - glbnv_blk[glbnv_nblk - 1].start;
+}
+
+/**
+ * @brief Rebuilds the records of the lines in glbnv_buffer.
+ *
+ * @param n Number of lines in glbnv_buffer or -1 if unknown.
+ */
+static void index_glbnv_names(int n) {
+    crange_valid = 0;
+    free_omnils_recs(&glbnv_recs);
+    free_NameHash(glbnv_names);
+    glbnv_names = NULL;
+    if (!glbnv_buffer)
+        return;
+    if (n < 0) {
+        n = 0;
+        for (const char *s = glbnv_buffer; *s; s++)
+            if (*s == '\n')
+                n++;
+    }
+    index_omnils(glbnv_buffer, n, 0, &glbnv_recs);
+    glbnv_names = new_NameHash(glbnv_recs.nbuf, glbnv_recs.name, glbnv_recs.n);
+}
+
 /**
  * @brief Updates the buffer containing the global environment data from R.
  *
@@ -1739,8 +3130,12 @@ static const char *write_ob_line(const char *p, const char *bs, char *prfx,
  */
 void update_glblenv_buffer(char *g) {
     Log("update_glblenv_buffer()");
-    int max;
+    ob_drop_index(&ob_glbnv);
     int glbnv_size;
+    int nlines;
+
+    glbnv_seq = 0;
+    glbnv_nblk = 0;
 
     if (glbnv_buffer) {
         if (strlen(g) > glbnv_buffer_sz) {
@@ -1753,50 +3148,398 @@ void update_glblenv_buffer(char *g) {
         glbnv_buffer = malloc(glbnv_buffer_sz * sizeof(char));
     }
     strcpy(glbnv_buffer, g);
-    if (check_omils_buffer(glbnv_buffer, &glbnv_size) == NULL)
+    if (check_omils_buffer(glbnv_buffer, &glbnv_size, &nlines) == NULL) {
+        // The buffer was freed by check_omils_buffer()
+        glbnv_buffer = NULL;
+        glbnv_buffer_sz = 0;
+        index_glbnv_names(0);
+        return;
+    }
+
+    index_glblenv_buffer();
+    index_glbnv_names(nlines);
+}
+
+/**
+ * @brief Asks nvimcom to send the complete list of objects in .GlobalEnv.
+ */
+static void request_glblenv_resync(void) {
+    Log("request_glblenv_resync()");
+    if (r_conn)
+        send_to_nvimcom("F");
+}
+
+/**
+ * @brief Finds the block of an object in the glbnv_buffer.
+ *
+ * The objects in a +D message are in the same order of the previous list, so
+ * the search starts at the block following the previous match.
+ *
+ * @param nm The object name.
+ * @param from Index of the first block to be checked.
+ * @return The index of the block or -1 if not found.
+ */
+static int find_glbnv_block(const char *nm, int from) {
+    for (int k = from; k < glbnv_nblk; k++)
+        if (strcmp(glbnv_buffer + glbnv_blk[k].start, nm) == 0)
+            return k;
+    for (int k = 0; k < from && k < glbnv_nblk; k++)
+        if (strcmp(glbnv_buffer + glbnv_blk[k].start, nm) == 0)
+            return k;
+    return -1;
+}
+
+/**
+ * @brief Copies lines in the omnils_ format, converting them as
+ * check_omils_buffer() does.
+ *
+ * @param dst Destination buffer.
+ * @param src Source lines. The copy stops at the end of the string or at a
+ * line beginning with \001 or \002.
+ * @param end Pointer to be set to the first byte not copied from src.
+ * @return Pointer to the byte following the last one copied to dst or NULL if
+ * a line does not have exactly 7 separators.
+ */
+static char *copy_omnils_lines(char *dst, const char *src, const char **end) {
+    int n = 0;
+    while (*src && *src != '\001' && *src != '\002') {
+        do {
+            switch (*src) {
+            case '\006':
+                *dst = 0;
+                n++;
+                break;
+            case '\'':
+                *dst = '\x13';
+                break;
+            case '\x12':
+                *dst = '\'';
+                break;
+            default:
+                *dst = *src;
+            }
+            dst++;
+            src++;
+        } while (*src && src[-1] != '\n');
+        if (n != 7 || src[-1] != '\n')
+            return NULL;
+        n = 0;
+    }
+    *end = src;
+    return dst;
+}
+
+/**
+ * @brief Patches the global environment buffer with the differences sent by
+ * nvimcom (see nvimcom_glbnv_delta() in nvimcom.c).
+ *
+ * If the sequence number is not the expected one, or if the message refers to
+ * an unknown object, the message is discarded and the complete list is
+ * requested.
+ *
+ * @param d The message without its "+D" prefix.
+ */
+void apply_glblenv_delta(char *d) {
+    Log("apply_glblenv_delta()");
+    ob_drop_index(&ob_glbnv);
+    char *s;
+    unsigned long seq = strtoul(d, &s, 10);
+
+    if (*s != '\003' || !glbnv_buffer || seq != glbnv_seq + 1) {
+        Log("apply_glblenv_delta: unexpected sequence number (%lu x %lu)", seq,
+            glbnv_seq);
+        request_glblenv_resync();
+        return;
+    }
+    s++;
+
+    // Each object of the old buffer is reused at most once. Then, the new
+    // buffer cannot be bigger than the old one plus the new lines.
+    size_t oldlen = glbnv_nblk ? glbnv_blk[glbnv_nblk - 1].start +
+                                     glbnv_blk[glbnv_nblk - 1].len
+                               : 0;
+    size_t nsz = oldlen + strlen(s) + 4096;
+    char *nbuf = malloc(nsz * sizeof(char));
+    char *p = nbuf;
+    GlbnvBlock *nblk = NULL;
+    int nn = 0;
+    int nblk_sz = 0;
+    int j = 0;
+    int k;
+
+    while (*s) {
+        if (*s == '\001') {
+            s++;
+            char *nm = s;
+            while (*s != '\n' && *s)
+                s++;
+            if (*s)
+                *s++ = 0;
+            replace_char(nm, '\'', '\x13');
+            replace_char(nm, '\x12', '\'');
+            k = find_glbnv_block(nm, j);
+            if (k < 0)
+                break;
+            memcpy(p, glbnv_buffer + glbnv_blk[k].start, glbnv_blk[k].len);
+            add_glbnv_block(&nblk, &nn, &nblk_sz, p - nbuf, glbnv_blk[k].len);
+            p += glbnv_blk[k].len;
+            j = k + 1;
+        } else if (*s == '\002') {
+            s++;
+            const char *e;
+            char *q = copy_omnils_lines(p, s, &e);
+            if (!q)
+                break;
+            add_glbnv_block(&nblk, &nn, &nblk_sz, p - nbuf, q - p);
+            p = q;
+            s = (char *)e;
+        } else {
+            break;
+        }
+    }
+
+    if (*s) {
+        Log("apply_glblenv_delta: invalid message");
+        free(nbuf);
+        free(nblk);
+        request_glblenv_resync();
         return;
+    }
+
+    *p = 0;
+    free(glbnv_buffer);
+    free(glbnv_blk);
+    glbnv_buffer = nbuf;
+    glbnv_buffer_sz = nsz;
+    glbnv_blk = nblk;
+    glbnv_nblk = nn;
+    glbnv_blk_sz = nblk_sz;
+    glbnv_seq = seq;
+    index_glbnv_names(-1);
+}
 
-    max = glbnv_size - 5;
+/**
+ * @brief Forgets the rendering of a view of the Object Browser sent to
+ * Neovim, so that the next one is sent in full. This is done when the Object
+ * Browser asks for a view because it was opened, switched views or missed an
+ * update.
+ */
+static void ob_forget(ObView *v) {
+    free(v->text);
+    free(v->line);
+    v->text = NULL;
+    v->line = NULL;
+    v->n = 0;
+}
 
-    for (int i = 0; i < max; i++)
-        if (glbnv_buffer[i] == '\003') {
-            i += 7;
+/**
+ * @brief Returns the level of a Lua long bracket that can quote the
+ * replacement lines of the hunks, that is, the smallest level greater than
+ * zero whose closing bracket is not in the lines.
+ */
+static int ob_bracket_level(const char **line, const ObHunk *h, long nh) {
+    uint64_t used = 1;
+    for (long i = 0; i < nh; i++) {
+        for (long j = h[i].b; j < h[i].b + h[i].nb; j++) {
+            for (const char *s = strchr(line[j], ']'); s;
+                 s = strchr(s + 1, ']')) {
+                const char *e = s + 1;
+                while (*e == '=')
+                    e++;
+                // A final ']=' would be closed by the ']' of ']=]'
+                if ((*e == ']' || *e == 0) && e - s - 1 < 64)
+                    used |= (uint64_t)1 << (e - s - 1);
+            }
         }
+    }
+    int lev = 1;
+    while (lev < 63 && (used >> lev) & 1)
+        lev++;
+    return lev;
 }
 
-void omni2ob(void) {
-    Log("omni2ob()");
-    FILE *f = fopen(globenv, "w");
-    if (!f) {
-        fprintf(stderr, "Error opening \"%s\" for writing\n", globenv);
-        fflush(stderr);
+/**
+ * @brief Sends to Neovim the changes in a view of the Object Browser.
+ *
+ * The lines just rendered by ob_render() are compared with the rendering
+ * previously sent, and only the changed lines are sent, as hunks of lines to
+ * replace, with the versions of both renderings. The hunks are sent in a Lua
+ * table of {start, end, number of lines, lines separated by '\006'}, with the
+ * lines numbered from 0 and end excluded. Version 0 means that the hunk
+ * replaces the whole buffer.
+ *
+ * @param v The view.
+ * @param text The text of the rendered lines, which is kept or freed.
+ * @param line The lines, which are kept or freed.
+ * @param n The number of lines.
+ */
+static void send_ob_update(ObView *v, char *text, const char **line, long n) {
+    ObHunk whole = {0, -1, 0, n};
+    ObHunk *h = NULL;
+    long nh = -1;
+    unsigned long base = 0;
+    if (v->text) {
+        nh = ob_diff(v->line, v->n, line, n, OB_MAX_DIFF, &h);
+        base = v->version;
+    }
+    if (nh == 0) {
+        free(line);
+        free(text);
+        free(h);
+        return;
+    }
+    const ObHunk *hk = h;
+    if (nh < 0) {
+        base = 0;
+        nh = 1;
+        hk = &whole;
+    }
+
+    char eq[64];
+    memset(eq, '=', sizeof(eq));
+    int lev = ob_bracket_level(line, hk, nh);
+    size_t sz = strlen(v->name) + 128;
+    for (long i = 0; i < nh; i++) {
+        sz += 80 + 2 * lev;
+        for (long j = hk[i].b; j < hk[i].b + hk[i].nb; j++)
+            sz += strlen(line[j]) + 1;
+    }
+    char *msg = malloc(sz);
+    if (!msg) {
+        free(line);
+        free(text);
+        free(h);
+        return;
+    }
+
+    char *p = msg;
+    p += sprintf(p, "lua require('r.browser').update_OB('%s', %lu, %lu, {",
+                 v->name, base, v->version + 1);
+    for (long i = 0; i < nh; i++) {
+        p += sprintf(p, "{%ld, %ld, %ld, [%.*s[", hk[i].a,
+                     hk[i].na < 0 ? -1 : hk[i].a + hk[i].na, hk[i].nb, lev,
+                     eq);
+        for (long j = hk[i].b; j < hk[i].b + hk[i].nb; j++) {
+            if (j > hk[i].b)
+                *p++ = '\006';
+            size_t len = strlen(line[j]);
+            memcpy(p, line[j], len);
+            p += len;
+        }
+        p += sprintf(p, "]%.*s]}, ", lev, eq);
+    }
+    p += sprintf(p, "})");
+    printf("\x11%" PRI_SIZET "\x11%s\n", (size_t)(p - msg), msg);
+    fflush(stdout);
+    free(msg);
+    free(h);
+
+    ob_forget(v);
+    v->text = text;
+    v->line = line;
+    v->n = n;
+    v->version++;
+}
+
+/**
+ * @brief Renders the lines of a view of the Object Browser that are in view,
+ * with a margin of OB_MARGIN lines, and sends them to Neovim.
+ *
+ * The other lines are sent empty, except the parents of the first line
+ * rendered, which browser.lua needs to get the names of the objects.
+ */
+static void ob_render(ObView *v, ObIndex *ix) {
+    static const char empty[] = "";
+    long first = v->top - OB_MARGIN;
+    long last = v->bot + OB_MARGIN;
+    if (first < 2)
+        first = 2;
+    if (last > ix->n)
+        last = ix->n;
+    if (first > last)
+        first = last;
+
+    // The parents of the first line, from the top
+    long parents[64];
+    int np = 0;
+    if (first < last)
+        for (long j = ix->l[first].parent; j >= 0 && np < 64;
+             j = ix->l[j].parent)
+            parents[np++] = j;
+
+    ObText t = {NULL, 0, 0};
+    const char **line = malloc(ix->n * sizeof(char *));
+    size_t *off = malloc((last - first + np + 2) * sizeof(size_t));
+    if (!line || !off) {
+        free(line);
+        free(off);
         return;
     }
+    for (long j = 0; j < ix->n; j++)
+        line[j] = empty;
+
+    int k = 0;
+    for (long j = 0; j < 2; j++) {
+        off[k++] = t.len;
+        ob_format_line(&t, ix->l + j, "");
+    }
+    for (int i = np - 1; i >= 0; i--) {
+        off[k++] = t.len;
+        ob_format_line(&t, ix->l + parents[i],
+                       ix->prfx.b + ix->l[parents[i]].prfx);
+    }
+    for (long j = first; j < last; j++) {
+        off[k++] = t.len;
+        ob_format_line(&t, ix->l + j, ix->prfx.b + ix->l[j].prfx);
+    }
+
+    if (t.b) {
+        k = 0;
+        for (long j = 0; j < 2; j++)
+            line[j] = t.b + off[k++];
+        for (int i = np - 1; i >= 0; i--)
+            line[parents[i]] = t.b + off[k++];
+        for (long j = first; j < last; j++)
+            line[j] = t.b + off[k++];
+    }
+    free(off);
+    send_ob_update(v, t.b, line, ix->n);
+}
 
-    fprintf(f, ".GlobalEnv | Libraries\n\n");
+/**
+ * @brief Indexes the .GlobalEnv view of the Object Browser and renders it.
+ *
+ * The index is kept to render other lines when the Object Browser is
+ * scrolled.
+ */
+void omni2ob(void) {
+    Log("omni2ob()");
+    ObIndex *ix = &ob_glbnv.ix;
+    ob_index_free(ix);
+    ob_index_init(ix, ".GlobalEnv | Libraries");
 
     if (glbnv_buffer) {
         const char *s = glbnv_buffer;
         while (*s)
-            s = write_ob_line(s, "", "", 0, f);
+            s = index_ob_line(s, NULL, "", "", 0, -1, ix, NULL);
+        flush_expansions();
     }
 
-    fclose(f);
-    if (auto_obbr) {
-        fputs("lua require('r.browser').update_OB('GlobalEnv')\n", stdout);
-        fflush(stdout);
-    }
+    if (auto_obbr)
+        ob_render(&ob_glbnv, ix);
 }
 
+/**
+ * @brief Indexes the Libraries view of the Object Browser and renders it.
+ *
+ * The index is kept to render other lines when the Object Browser is
+ * scrolled.
+ */
 void lib2ob(void) {
     Log("lib2ob()");
-    FILE *f = fopen(liblist, "w");
-    if (!f) {
-        fprintf(stderr, "Failed to open \"%s\"\n", liblist);
-        fflush(stderr);
-        return;
-    }
-    fprintf(f, "Libraries | .GlobalEnv\n\n");
+    ObIndex *ix = &ob_libs.ix;
+    ob_index_free(ix);
+    ob_index_init(ix, "Libraries | .GlobalEnv");
 
     char lbnmc[512];
     PkgData *pkg;
@@ -1806,46 +3549,54 @@ void lib2ob(void) {
     pkg = pkgList;
     while (pkg) {
         if (pkg->loaded) {
-            if (pkg->descr)
-                fprintf(f, "   :#%s\t%s\n", pkg->name, pkg->descr);
-            else
-                fprintf(f, "   :#%s\t\n", pkg->name);
+            long ln = ob_add_line(ix, pkg->name, pkg->descr ? pkg->descr : "",
+                                  ':', 1, "", -1);
             snprintf(lbnmc, 511, "%s:", pkg->name);
             stt = get_list_status(lbnmc, 0);
             if (pkg->omnils && pkg->nobjs > 0 && stt == 1) {
-                p = pkg->omnils;
+                // The lines are converted in the compl_ file, but those of
+                // the omnils_ file, mapped read-only, are indexed raw. They
+                // end with the last new line.
+                PkgData *raw = pkg->recs.raw ? pkg : NULL;
+                const char *end = NULL;
+                p = pkg->recs.buf;
+                if (raw) {
+                    end = p + pkg->omnils_sz;
+                    while (end > p && end[-1] != '\n')
+                        end--;
+                }
                 nLibObjs = pkg->nobjs - 1;
-                while (*p) {
+                while (end ? p < end : *p != 0) {
                     if (nLibObjs == 0)
-                        p = write_ob_line(p, "", strL, 1, f);
+                        p = index_ob_line(p, end, "", strL, 1, ln, ix, raw);
                     else
-                        p = write_ob_line(p, "", strT, 1, f);
+                        p = index_ob_line(p, end, "", strT, 1, ln, ix, raw);
                 }
             }
         }
         pkg = pkg->next;
     }
 
-    fclose(f);
-    fputs("lua require('r.browser').update_OB('libraries')\n", stdout);
-    fflush(stdout);
+    ob_render(&ob_libs, ix);
 }
 
-void change_all(ListStatus *root, int stt) {
-    if (root != NULL) {
+void change_all(ListStatusTable *t, int stt) {
+    load_list_status();
+    list_status_changed = 1;
+    for (unsigned int i = 0; i < t->n; i++) {
+        ListStatus *p = list_status_at(t, i);
         // Open all but libraries
-        if (!(stt == 1 && root->key[strlen(root->key) - 1] == ':'))
-            root->status = stt;
-        change_all(root->left, stt);
-        change_all(root->right, stt);
+        if (!(stt == 1 && p->key[strlen(p->key) - 1] == ':')) {
+            p->status = stt;
+            p->user = 1;
+        }
     }
 }
 
-void print_listTree(ListStatus *root, FILE *f) {
-    if (root != NULL) {
-        fprintf(f, "%d :: %s\n", root->status, root->key);
-        print_listTree(root->left, f);
-        print_listTree(root->right, f);
+void print_listTree(ListStatusTable *t, FILE *f) {
+    for (unsigned int i = 0; i < t->n; i++) {
+        ListStatus *p = list_status_at(t, i);
+        fprintf(f, "%d :: %s\n", p->status, p->key);
     }
 }
 
@@ -1933,6 +3684,7 @@ static void init(void) {
     fprintf(f, "NSERVER LOG | %s\n\n", ctime(&t));
     fclose(f);
 #endif
+    Log("scan_omnils() kernel: %s", scan_kernel());
 
     char envstr[1024];
 
@@ -1974,8 +3726,6 @@ static void init(void) {
         strncpy(localtmpdir, getenv("RNVIM_TMPDIR"), 255);
     }
 
-    snprintf(liblist, 575, "%s/liblist_%s", localtmpdir, getenv("RNVIM_ID"));
-    snprintf(globenv, 575, "%s/globenv_%s", localtmpdir, getenv("RNVIM_ID"));
 
     if (getenv("RNVIM_OPENDF"))
         OpenDF = 1;
@@ -1989,13 +3739,28 @@ static void init(void) {
         allnames = 1;
     else
         allnames = 0;
+    if (getenv("RNVIM_MAX_COMPL"))
+        max_compl = atoi(getenv("RNVIM_MAX_COMPL"));
+    if (getenv("RNVIM_BUILD_WORKERS"))
+        build_workers = atoi(getenv("RNVIM_BUILD_WORKERS"));
+#ifndef WIN32
+    if (build_workers < 1)
+        build_workers = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (build_workers < 1)
+        build_workers = 1;
+#ifndef WIN32
+    if (getenv("RNVIM_BUILD_HELPER"))
+        build_helper = 1;
+#endif
 
     // Fill immediately the list of installed libraries. Each entry still has
     // to be confirmed by listing the directories in .libPaths.
     fill_inst_libs();
 
     // List tree sentinel
-    listTree = new_ListStatus("base:", 0);
+    listTree = new_ListStatusTable();
+    list_status_add(listTree, "base:", 0);
 
     compl_buffer = calloc(compl_buffer_size, sizeof(char));
 
@@ -2038,18 +3803,6 @@ static void init(void) {
     Log("init() finished");
 }
 
-int count_twice(const char *b1, const char *b2, const char ch) {
-    int n1 = 0;
-    int n2 = 0;
-    for (unsigned long i = 0; i < strlen(b1); i++)
-        if (b1[i] == ch)
-            n1++;
-    for (unsigned long i = 0; i < strlen(b2); i++)
-        if (b2[i] == ch)
-            n2++;
-    return n1 == n2;
-}
-
 /*
  * TODO: Candidate for completion_services.c
  *
@@ -2059,232 +3812,352 @@ int count_twice(const char *b1, const char *b2, const char ch) {
  * @param pkg:
  * */
 void completion_info(const char *wrd, const char *pkg) {
-    int i;
     unsigned long nsz;
-    const char *f[7];
-    char *s;
+    const OmnilsRecs *r;
+    int k;
 
     if (strcmp(pkg, ".GlobalEnv") == 0) {
-        s = glbnv_buffer;
+        r = &glbnv_recs;
+        k = name_hash_get(glbnv_names, wrd);
     } else {
-        PkgData *pd = pkgList;
-        while (pd) {
-            if (strcmp(pkg, pd->name) == 0)
-                break;
-            else
-                pd = pd->next;
-        }
-
+        PkgData *pd = get_pkg(pkg);
         if (pd == NULL)
             return;
+        r = &pd->recs;
+        k = pkg_name_get(pd, wrd);
+    }
 
-        s = pd->omnils;
+    if (k < 0) {
+        printf("lua %s({})\n", compl_info);
+        fflush(stdout);
+        return;
     }
 
     memset(compl_buffer, 0, compl_buffer_size);
     char *p = compl_buffer;
 
-    while (*s != 0) {
-        if (strcmp(s, wrd) == 0) {
-            i = 0;
-            while (i < 7) {
-                f[i] = s;
-                i++;
-                while (*s != 0)
-                    s++;
-                s++;
-            }
-            while (*s != '\n' && *s != 0)
-                s++;
-            if (*s == '\n')
-                s++;
-
-            if (f[1][0] == '\003' && str_here(f[4], "[\x12not_checked\x12]")) {
-                snprintf(compl_buffer, 1024,
-                         "E%snvimcom:::nvim.GlobalEnv.fun.args(\"%s\")\n",
-                         getenv("RNVIM_ID"), wrd);
-                send_to_nvimcom(compl_buffer);
-                return;
-            }
-
-            // Avoid buffer overflow if the information is bigger than
-            // compl_buffer.
-            nsz = strlen(f[4]) + strlen(f[5]) + strlen(f[6]) + 1024 +
-                  (p - compl_buffer);
-            if (compl_buffer_size < nsz)
-                p = grow_buffer(&compl_buffer, &compl_buffer_size,
-                                nsz - compl_buffer_size);
-
-            p = str_cat(p, "{cls = '");
-            if (f[1][0] == '\003')
-                p = str_cat(p, "f");
-            else
-                p = str_cat(p, f[1]);
-            p = str_cat(p, "', word = '");
-            p = str_cat(p, wrd);
-            p = str_cat(p, "', pkg = '");
-            p = str_cat(p, f[3]);
-            p = str_cat(p, "', usage = {");
-            p = str_cat(p, f[4]);
-            p = str_cat(p, "}, ttl = '");
-            p = str_cat(p, f[5]);
-            p = str_cat(p, "', descr = '");
-            p = str_cat(p, f[6]);
-            p = str_cat(p, "'}");
-            printf("lua %s(%s)\n", compl_info, compl_buffer);
-            fflush(stdout);
-            return;
-        }
-        while (*s != '\n')
-            s++;
-        s++;
+    // The arguments of functions in .GlobalEnv are checked on demand
+    if (r->type[k] == '\003' && !r->raw &&
+        str_here(rec_field(r, k, 4), "[\x12not_checked\x12]")) {
+        snprintf(compl_buffer, 1024,
+                 "E%snvimcom:::nvim.GlobalEnv.fun.args(\"%s\")\n",
+                 getenv("RNVIM_ID"), wrd);
+        send_to_nvimcom(compl_buffer);
+        return;
     }
-    printf("lua %s({})\n", compl_info);
+
+    // Avoid buffer overflow if the information is bigger than
+    // compl_buffer.
+    nsz = rec_flen(r, k, 1) + rec_flen(r, k, 3) + rec_flen(r, k, 4) +
+          rec_flen(r, k, 5) + rec_flen(r, k, 6) + strlen(wrd) + 1024 +
+          (p - compl_buffer);
+    if (compl_buffer_size < nsz)
+        p = grow_buffer(&compl_buffer, &compl_buffer_size,
+                        nsz - compl_buffer_size);
+
+    p = str_cat(p, "{cls = '");
+    if (r->type[k] == '\003')
+        p = str_cat(p, "f");
+    else
+        p = cat_field(p, r, k, 1);
+    p = str_cat(p, "', word = '");
+    p = str_cat(p, wrd);
+    p = str_cat(p, "', pkg = '");
+    p = cat_field(p, r, k, 3);
+    p = str_cat(p, "', usage = {");
+    p = cat_field(p, r, k, 4);
+    p = str_cat(p, "}, ttl = '");
+    p = cat_field(p, r, k, 5);
+    p = str_cat(p, "', descr = '");
+    p = cat_field(p, r, k, 6);
+    p = str_cat(p, "'}");
+    printf("lua %s(%s)\n", compl_info, compl_buffer);
     fflush(stdout);
 }
 
 // Return the menu items for omni completion, but don't include function
 // usage, and tittle and description of objects because if the buffer becomes
 // too big it will be truncated.
-char *parse_omnils(const char *s, const char *base, const char *pkg, char *p) {
-    int i;
+/**
+ * @brief Appends the completion item of an omnils record to compl_buffer.
+ *
+ * @param r The records.
+ * @param k The record.
+ * @param bsep Number of '@', '$' and '[' in the completion base (see
+ * name_seps()).
+ * @param pkg Package name to be prefixed to the word or NULL.
+ * @param p Pointer to the end of compl_buffer.
+ * @return The pointer p updated.
+ */
+static char *omnils_to_compl(const OmnilsRecs *r, int k, uint32_t bsep,
+                             const char *pkg, char *p) {
     unsigned long nsz;
-    const char *f[7];
-
-    while (*s != 0) {
-        if (str_here(s, base)) {
-            i = 0;
-            while (i < 7) {
-                f[i] = s;
-                i++;
-                while (*s != 0)
-                    s++;
-                s++;
-            }
-            while (*s != '\n' && *s != 0)
-                s++;
-            if (*s == '\n')
-                s++;
-
-            // Skip elements of lists unless the user is really looking for
-            // them, and skip lists if the user is looking for one of its
-            // elements.
-            if (!count_twice(base, f[0], '@'))
-                continue;
-            if (!count_twice(base, f[0], '$'))
-                continue;
-            if (!count_twice(base, f[0], '['))
-                continue;
-
-            // Avoid buffer overflow if the information is bigger than
-            // compl_buffer.
-            nsz = strlen(f[0]) + 1024 + (p - compl_buffer);
-            if (compl_buffer_size < nsz)
-                p = grow_buffer(&compl_buffer, &compl_buffer_size,
-                                nsz - compl_buffer_size);
 
-            p = str_cat(p, "{word = '");
-            if (pkg) {
-                p = str_cat(p, pkg);
-                p = str_cat(p, "::");
-            }
-            p = str_cat(p, f[0]);
-            p = str_cat(p, "', menu = '");
-            if (f[2][0] != 0) {
-                p = str_cat(p, f[2]);
-            } else {
-                switch (f[1][0]) {
-                case '{':
-                    p = str_cat(p, "num ");
-                    break;
-                case '~':
-                    p = str_cat(p, "char");
-                    break;
-                case '!':
-                    p = str_cat(p, "fac ");
-                    break;
-                case '$':
-                    p = str_cat(p, "data");
-                    break;
-                case '[':
-                    p = str_cat(p, "list");
-                    break;
-                case '%':
-                    p = str_cat(p, "log ");
-                    break;
-                case '\003':
-                    p = str_cat(p, "func");
-                    break;
-                case '<':
-                    p = str_cat(p, "S4  ");
-                    break;
-                case '&':
-                    p = str_cat(p, "lazy");
-                    break;
-                case ':':
-                    p = str_cat(p, "env ");
-                    break;
-                case '*':
-                    p = str_cat(p, "?   ");
-                    break;
-                }
-            }
-            p = str_cat(p, " [");
-            p = str_cat(p, f[3]);
-            p = str_cat(p, "]', user_data = {cls = '");
-            if (f[1][0] == '\003')
-                p = str_cat(p, "f");
-            else
-                p = str_cat(p, f[1]);
-            p = str_cat(p, "', pkg = '");
-            p = str_cat(p, f[3]);
-            p = str_cat(p, "'}}, "); // Don't include fields 4, 5 and 6 because
-                                     // big data will be truncated.
-        } else {
-            while (*s != '\n')
-                s++;
-            s++;
+    // Skip elements of lists unless the user is really looking for
+    // them, and skip lists if the user is looking for one of its
+    // elements.
+    TOUCHED(sizeof(uint32_t));
+    if (r->nsep[k] != bsep)
+        return p;
+    // The name, its offset, the offsets of the fields and the type
+    TOUCHED(rec_flen(r, k, 0) + 8 * sizeof(uint32_t) + 1);
+
+    // Avoid buffer overflow if the information is bigger than
+    // compl_buffer.
+    nsz = rec_flen(r, k, 0) + rec_flen(r, k, 2) + 2 * rec_flen(r, k, 3) +
+          1024 + (p - compl_buffer);
+    if (compl_buffer_size < nsz)
+        p = grow_buffer(&compl_buffer, &compl_buffer_size,
+                        nsz - compl_buffer_size);
+
+    p = str_cat(p, "{word = '");
+    if (pkg) {
+        p = str_cat(p, pkg);
+        p = str_cat(p, "::");
+    }
+    p = cat_field(p, r, k, 0);
+    p = str_cat(p, "', menu = '");
+    if (rec_flen(r, k, 2) != 0) {
+        p = cat_field(p, r, k, 2);
+    } else {
+        switch (r->type[k]) {
+        case '{':
+            p = str_cat(p, "num ");
+            break;
+        case '~':
+            p = str_cat(p, "char");
+            break;
+        case '!':
+            p = str_cat(p, "fac ");
+            break;
+        case '$':
+            p = str_cat(p, "data");
+            break;
+        case '[':
+            p = str_cat(p, "list");
+            break;
+        case '%':
+            p = str_cat(p, "log ");
+            break;
+        case '\003':
+            p = str_cat(p, "func");
+            break;
+        case '<':
+            p = str_cat(p, "S4  ");
+            break;
+        case '&':
+            p = str_cat(p, "lazy");
+            break;
+        case ':':
+            p = str_cat(p, "env ");
+            break;
+        case '*':
+            p = str_cat(p, "?   ");
+            break;
         }
     }
+    p = str_cat(p, " [");
+    p = cat_field(p, r, k, 3);
+    p = str_cat(p, "]', user_data = {cls = '");
+    if (r->type[k] == '\003')
+        p = str_cat(p, "f");
+    else
+        p = cat_field(p, r, k, 1);
+    p = str_cat(p, "', pkg = '");
+    p = cat_field(p, r, k, 3);
+    p = str_cat(p, "'}}, "); // Don't include fields 4, 5 and 6 because
+                             // big data will be truncated.
     return p;
 }
 
-void resolve_arg_item(char *pkg, char *fnm, char *itm) {
-    char item[128];
-    snprintf(item, 127, "%s\005", itm);
-    PkgData *p = pkgList;
-    while (p) {
-        if (strcmp(p->name, pkg) == 0) {
-            if (p->args) {
-                char *s = p->args;
-                while (*s) {
-                    if (strcmp(s, fnm) == 0) {
-                        while (*s)
-                            s++;
-                        s++;
-                        while (*s != '\n') {
-                            if (str_here(s, item)) {
-                                while (*s && *s != '\005')
-                                    s++;
-                                s++;
-                                printf("lua "
-                                       "require'cmp_r'.finish_get_args('%s')\n",
-                                       s);
-                                fflush(stdout);
-                            }
-                            s++;
-                        }
-                        return;
-                    } else {
-                        while (*s != '\n')
-                            s++;
-                        s++;
-                    }
-                }
+/**
+ * @brief Finds the names beginning with `base` in a range of a sorted index
+ * built by index_omnils(). The names are contiguous in the index.
+ *
+ * @param r The records.
+ * @param lo First position of the range to be searched.
+ * @param hi One past the last position of the range.
+ * @param base The completion base.
+ * @param first Pointer to be set to the position of the first name found.
+ * @param last Pointer to be set to one past the position of the last name.
+ */
+static void prefix_range(const OmnilsRecs *r, int lo, int hi,
+                         const char *base, int *first, int *last) {
+    size_t blen = strlen(base);
+    int end = hi;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        TOUCHED(sizeof(uint32_t) + blen + 1);
+        if (strcmp(rec_field(r, mid, 0), base) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *first = lo;
+    hi = end;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        TOUCHED(sizeof(uint32_t) + blen);
+        if (strncmp(rec_field(r, mid, 0), base, blen) == 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *last = lo;
+}
+
+/**
+ * @brief Appends to compl_buffer the completion items of a range of omnils
+ * records.
+ *
+ * The range is paged according to compl_skip and compl_left, and the names
+ * left out are counted in compl_more, without scanning them.
+ *
+ * @param r The records.
+ * @param first First record of the range.
+ * @param last One past the last record of the range.
+ * @param bsep Number of '@', '$' and '[' in the completion base.
+ * @param pkg Package name to be prefixed to the words or NULL.
+ * @param p Pointer to the end of compl_buffer.
+ * @return The pointer p updated.
+ */
+static char *page_range(const OmnilsRecs *r, int first, int last,
+                        uint32_t bsep, const char *pkg, char *p) {
+    int skip = last - first < compl_skip ? last - first : compl_skip;
+    compl_skip -= skip;
+    first += skip;
+    int take = last - first < compl_left ? last - first : compl_left;
+    compl_left -= take;
+    compl_more += last - first - take;
+
+    for (int i = first; i < first + take; i++)
+        p = omnils_to_compl(r, i, bsep, pkg, p);
+    return p;
+}
+
+/**
+ * @brief Adds a range to the cache of the last completion.
+ */
+static void add_compl_range(const OmnilsRecs *recs, int first, int last,
+                            PkgData *pd) {
+    if (first == last)
+        return;
+    if (ncrange == crange_sz) {
+        crange_sz += 64;
+        crange = realloc(crange, crange_sz * sizeof(ComplRange));
+    }
+    crange[ncrange].recs = recs;
+    crange[ncrange].first = first;
+    crange[ncrange].last = last;
+    crange[ncrange].pd = pd;
+    ncrange++;
+}
+
+/**
+ * @brief Appends to compl_buffer the completion items of the objects whose
+ * names begin with `base`, in .GlobalEnv and in the loaded packages.
+ *
+ * The ranges of the sorted indexes matching the base are kept. If the next
+ * base extends the current one (e.g. `re` -> `rea`), only these ranges are
+ * narrowed instead of searching all indexes again. The cache is invalidated
+ * when either .GlobalEnv or the list of packages change.
+ *
+ * @param base The completion base, optionally prefixed by "pkg::".
+ * @param p Pointer to the end of compl_buffer.
+ * @return The pointer p updated.
+ */
+static char *complete_names(char *base, char *p) {
+    char fullbase[512];
+    snprintf(fullbase, sizeof(fullbase), "%s", base);
+
+    // Check if base is "pkg::fun"
+    char *pkg = NULL;
+    if (strstr(base, "::")) {
+        pkg = base;
+        base = strstr(base, "::");
+        *base = 0;
+        base++;
+        base++;
+        bol_hurry(pkg);
+    }
+
+    int first, last;
+    if (crange_valid && str_here(fullbase, crange_base) &&
+        (pkg != NULL) == (strstr(crange_base, "::") != NULL)) {
+        int n = 0;
+        for (int i = 0; i < ncrange; i++) {
+            ComplRange *r = crange + i;
+            prefix_range(r->recs, r->first, r->last,
+                         r->pd ? base : fullbase,
+                         &first, &last);
+            if (first < last) {
+                crange[n] = *r;
+                crange[n].first = first;
+                crange[n].last = last;
+                n++;
             }
-            break;
         }
-        p = p->next;
+        ncrange = n;
+    } else {
+        ncrange = 0;
+        if (glbnv_recs.n) {
+            prefix_range(&glbnv_recs, 0, glbnv_recs.n, fullbase, &first,
+                         &last);
+            add_compl_range(&glbnv_recs, first, last, NULL);
+        }
+        for (PkgData *pd = pkgList; pd; pd = pd->next) {
+            if (pd->recs.n && (pkg == NULL || strcmp(pd->name, pkg) == 0)) {
+                prefix_range(&pd->recs, 0, pd->recs.n, base, &first,
+                             &last);
+                add_compl_range(&pd->recs, first, last, pd);
+            }
+        }
+        crange_valid = 1;
+    }
+    memcpy(crange_base, fullbase, sizeof(crange_base));
+
+    uint32_t bsep = name_seps(base);
+    uint32_t fsep = name_seps(fullbase);
+    for (int i = 0; i < ncrange; i++) {
+        ComplRange *r = crange + i;
+        if (r->pd)
+            p = page_range(r->recs, r->first, r->last, bsep,
+                           pkg ? r->pd->name : NULL, p);
+        else
+            p = page_range(r->recs, r->first, r->last, fsep, NULL, p);
+    }
+    return p;
+}
+
+void resolve_arg_item(char *pkg, char *fnm, char *itm) {
+    char item[128];
+    snprintf(item, 127, "%s\005", itm);
+    PkgData *p = get_pkg(pkg);
+    if (!p)
+        return;
+    if (!map_pkg_args(p)) {
+        bol_hurry(pkg);
+        return;
+    }
+    int k = name_hash_get(p->fargs, fnm);
+    if (k < 0)
+        return;
+    const char *s = p->args + p->argo[k];
+    while (*s != '\006' && *s != '\n')
+        s++;
+    if (*s == '\n')
+        return;
+    s++;
+    while (*s != '\n') {
+        if (str_here(s, item)) {
+            s += strlen(item);
+            int len = 0;
+            while (s[len] != '\006' && s[len] != '\n')
+                len++;
+            printf("lua require'cmp_r'.finish_get_args('%.*s')\n", len, s);
+            fflush(stdout);
+        }
+        s++;
     }
 }
 
@@ -2304,36 +4177,22 @@ char *complete_args(char *p, char *funcnm) {
         *funcnm = 0;
         funcnm++;
         funcnm++;
+        bol_hurry(pkg);
     }
 
     PkgData *pd = pkgList;
-    char *s;
     while (pd) {
         if (pd->omnils &&
             (pkg == NULL || (pkg && strcmp(pd->name, pkg) == 0))) {
-            s = pd->omnils;
-            while (*s != 0) {
-                if (strcmp(s, funcnm) == 0) {
-                    int i = 4;
-                    while (i) {
-                        s++;
-                        if (*s == 0)
-                            i--;
-                    }
-                    s++;
-                    p = str_cat(p, "{pkg = '");
-                    p = str_cat(p, pd->name);
-                    p = str_cat(p, "', fnm = '");
-                    p = str_cat(p, funcnm);
-                    p = str_cat(p, "', args = {");
-                    p = str_cat(p, s);
-                    p = str_cat(p, "}},");
-                    break;
-                } else {
-                    while (*s != '\n')
-                        s++;
-                    s++;
-                }
+            int k = pkg_name_get(pd, funcnm);
+            if (k >= 0) {
+                p = str_cat(p, "{pkg = '");
+                p = str_cat(p, pd->name);
+                p = str_cat(p, "', fnm = '");
+                p = str_cat(p, funcnm);
+                p = str_cat(p, "', args = {");
+                p = cat_field(p, &pd->recs, k, 4);
+                p = str_cat(p, "}},");
             }
         }
         pd = pd->next;
@@ -2341,6 +4200,230 @@ char *complete_args(char *p, char *funcnm) {
     return p;
 }
 
+// Fuzzy completion scores, as in fzy (https://github.com/jhawthorn/fzy)
+#define SCORE_MIN -1e9
+#define SCORE_GAP_LEADING -0.005
+#define SCORE_GAP_TRAILING -0.005
+#define SCORE_GAP_INNER -0.01
+#define SCORE_MATCH_CONSECUTIVE 1.0
+#define SCORE_MATCH_WORD 0.8
+#define SCORE_MATCH_CAPITAL 0.7
+#define SCORE_MATCH_DOT 0.6
+#define FUZZY_MAX_LEN 128 // Longer names are not scored
+#define FUZZY_TOP_K 100   // Maximum number of fuzzy completion items
+
+typedef struct fuzzy_item_ {
+    double score;     // Score of the match
+    const OmnilsRecs *recs; // The records of the omnils
+    int k;                  // The record
+    const char *pkg;  // Package to be prefixed to the word or NULL
+} FuzzyItem;
+
+static FuzzyItem fuzzy_heap[FUZZY_TOP_K]; // Min-heap with the best matches
+static int fuzzy_n;                       // Number of items in fuzzy_heap
+static int fuzzy_k; // Capacity of fuzzy_heap in the current completion
+
+/**
+ * @brief Bonus for matching a character after `prev`: beginning of words in
+ * snake_case, dot.case and camelCase names.
+ */
+static double fuzzy_bonus(char prev, char c) {
+    if (prev == 0 || prev == '_' || prev == '$' || prev == '@' || prev == '[')
+        return SCORE_MATCH_WORD;
+    if (prev == '.')
+        return SCORE_MATCH_DOT;
+    if (islower((unsigned char)prev) && isupper((unsigned char)c))
+        return SCORE_MATCH_CAPITAL;
+    return 0.0;
+}
+
+/**
+ * @brief Scores a name as a fuzzy match of the query, using the dynamic
+ * programming algorithm of fzy: consecutive matches and matches at the
+ * beginning of words are rewarded and gaps are penalized.
+ *
+ * @param q The query in lower case.
+ * @param m Length of the query.
+ * @param s The name.
+ * @param n Length of the name.
+ * @return The score or SCORE_MIN if q is not a subsequence of s.
+ */
+static double fuzzy_score(const char *q, int m, const char *s, int n) {
+    double D[FUZZY_MAX_LEN]; // Best score ending with a match at j
+    double M[FUZZY_MAX_LEN]; // Best score up to j
+    double pD[FUZZY_MAX_LEN];
+    double pM[FUZZY_MAX_LEN];
+    double bonus[FUZZY_MAX_LEN];
+    char lc[FUZZY_MAX_LEN];
+
+    if (n == 0 || n > FUZZY_MAX_LEN || m > n)
+        return SCORE_MIN;
+
+    // Cheap subsequence check before the quadratic part
+    int k = 0;
+    for (int j = 0; j < n && k < m; j++)
+        if (tolower((unsigned char)s[j]) == q[k])
+            k++;
+    if (k < m)
+        return SCORE_MIN;
+    for (int j = 0; j < n; j++) {
+        lc[j] = tolower((unsigned char)s[j]);
+        bonus[j] = fuzzy_bonus(j ? s[j - 1] : 0, s[j]);
+    }
+
+    for (int i = 0; i < m; i++) {
+        double prev = SCORE_MIN;
+        double gap = i == m - 1 ? SCORE_GAP_TRAILING : SCORE_GAP_INNER;
+        for (int j = 0; j < n; j++) {
+            if (lc[j] == q[i]) {
+                double score = SCORE_MIN;
+                if (i == 0) {
+                    score = j * SCORE_GAP_LEADING + bonus[j];
+                } else if (j > 0) {
+                    double a = pM[j - 1] + bonus[j];
+                    double b = pD[j - 1] + SCORE_MATCH_CONSECUTIVE;
+                    score = a > b ? a : b;
+                }
+                D[j] = score;
+                prev = score > prev + gap ? score : prev + gap;
+            } else {
+                D[j] = SCORE_MIN;
+                prev = prev + gap;
+            }
+            M[j] = prev;
+        }
+        memcpy(pD, D, n * sizeof(double));
+        memcpy(pM, M, n * sizeof(double));
+    }
+    return M[n - 1];
+}
+
+static void fuzzy_heap_swap(int a, int b) {
+    FuzzyItem tmp = fuzzy_heap[a];
+    fuzzy_heap[a] = fuzzy_heap[b];
+    fuzzy_heap[b] = tmp;
+}
+
+static void fuzzy_heap_down(int i, int n) {
+    for (;;) {
+        int l = 2 * i + 1;
+        int r = l + 1;
+        int min = i;
+        if (l < n && fuzzy_heap[l].score < fuzzy_heap[min].score)
+            min = l;
+        if (r < n && fuzzy_heap[r].score < fuzzy_heap[min].score)
+            min = r;
+        if (min == i)
+            return;
+        fuzzy_heap_swap(i, min);
+        i = min;
+    }
+}
+
+/**
+ * @brief Keeps the fuzzy_k best matches in fuzzy_heap.
+ */
+static void fuzzy_heap_push(double score, const OmnilsRecs *r, int k,
+                            const char *pkg) {
+    if (fuzzy_n < fuzzy_k) {
+        int i = fuzzy_n++;
+        fuzzy_heap[i].score = score;
+        fuzzy_heap[i].recs = r;
+        fuzzy_heap[i].k = k;
+        fuzzy_heap[i].pkg = pkg;
+        while (i > 0 && fuzzy_heap[(i - 1) / 2].score > fuzzy_heap[i].score) {
+            fuzzy_heap_swap(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    } else if (score > fuzzy_heap[0].score) {
+        fuzzy_heap[0].score = score;
+        fuzzy_heap[0].recs = r;
+        fuzzy_heap[0].k = k;
+        fuzzy_heap[0].pkg = pkg;
+        fuzzy_heap_down(0, fuzzy_n);
+    }
+}
+
+/**
+ * @brief Scores the names of an index as fuzzy matches of the query.
+ *
+ * Names lacking any character of the query, too short or too long are
+ * discarded by comparing the records before scoring.
+ */
+static void fuzzy_scan(const OmnilsRecs *r, uint32_t bsep, const char *q,
+                       int m, uint64_t qmask, const char *pkg) {
+    // The mask, the separators and the length of every name
+    TOUCHED((size_t)r->n * (sizeof(uint64_t) + sizeof(uint32_t) +
+                            sizeof(uint16_t)));
+    for (int i = 0; i < r->n; i++) {
+        if ((r->cmask[i] & qmask) != qmask || r->nsep[i] != bsep ||
+            r->nlen[i] > FUZZY_MAX_LEN || r->nlen[i] < m)
+            continue;
+        TOUCHED(sizeof(uint32_t) + r->nlen[i]);
+        double sc = fuzzy_score(q, m, rec_field(r, i, 0), r->nlen[i]);
+        if (sc > SCORE_MIN)
+            fuzzy_heap_push(sc, r, i, pkg);
+    }
+}
+
+/**
+ * @brief Completes names whose characters include the base as a subsequence
+ * (e.g. `rdcsv` for `read_csv`). Only the FUZZY_TOP_K (or max_compl, if
+ * smaller) best matches are returned, from the highest score to the lowest
+ * one. Nothing is returned for an empty query.
+ *
+ * @param id Completion id.
+ * @param base The completion base, optionally prefixed by "pkg::".
+ */
+void complete_fuzzy(const char *id, char *base) {
+    Log("complete_fuzzy(%s, %s)", id, base);
+    char q[FUZZY_MAX_LEN + 1];
+    char *p;
+
+    memset(compl_buffer, 0, compl_buffer_size);
+    p = compl_buffer;
+    fuzzy_n = 0;
+    fuzzy_k = max_compl > 0 && max_compl < FUZZY_TOP_K ? max_compl : FUZZY_TOP_K;
+
+    char *pkg = NULL;
+    if (strstr(base, "::")) {
+        pkg = base;
+        base = strstr(base, "::");
+        *base = 0;
+        base += 2;
+    }
+
+    int m = strlen(base);
+    if (m > 0 && m <= FUZZY_MAX_LEN) {
+        for (int i = 0; i <= m; i++)
+            q[i] = tolower((unsigned char)base[i]);
+        uint64_t qmask = name_mask(q);
+
+        uint32_t bsep = name_seps(base);
+        if (!pkg)
+            fuzzy_scan(&glbnv_recs, bsep, q, m, qmask, NULL);
+        for (PkgData *pd = pkgList; pd; pd = pd->next)
+            if (pkg == NULL || strcmp(pd->name, pkg) == 0)
+                fuzzy_scan(&pd->recs, bsep, q, m, qmask, pkg);
+    }
+
+    // Sort the heap from the best to the worst match
+    for (int n = fuzzy_n - 1; n > 0; n--) {
+        fuzzy_heap_swap(0, n);
+        fuzzy_heap_down(0, n);
+    }
+    for (int i = 0; i < fuzzy_n; i++)
+        p = omnils_to_compl(fuzzy_heap[i].recs, fuzzy_heap[i].k,
+                            name_seps(base), fuzzy_heap[i].pkg, p);
+
+    printf("\x11%" PRI_SIZET "\x11"
+           "lua %s(%s, {%s})\n",
+           strlen(compl_cb) + strlen(id) + strlen(compl_buffer) + 10, compl_cb,
+           id, compl_buffer);
+    fflush(stdout);
+    LOG_TOUCHED("complete_fuzzy");
+}
+
 /*
  * TODO: Candidate for completion_services.c
  *
@@ -2397,223 +4480,384 @@ void complete(const char *id, char *base, char *funcnm, char *args) {
                    strlen(compl_cb) + strlen(id) + strlen(compl_buffer) + 10,
                    compl_cb, id, compl_buffer);
             fflush(stdout);
+            LOG_TOUCHED("complete");
             return;
         }
     }
 
     // Finish filling the compl_buffer
-    if (glbnv_buffer)
-        p = parse_omnils(glbnv_buffer, base, NULL, p);
-    PkgData *pd = pkgList;
-
-    // Check if base is "pkg::fun"
-    char *pkg = NULL;
-    if (strstr(base, "::")) {
-        pkg = base;
-        base = strstr(base, "::");
-        *base = 0;
-        base++;
-        base++;
+    compl_left = max_compl > 0 ? max_compl : INT_MAX;
+    compl_more = 0;
+    if (glbnv_buffer) {
+        expand_completion_base(base);
+        flush_expansions();
     }
+    p = complete_names(base, p);
 
-    while (pd) {
-        if (pd->omnils && (pkg == NULL || (pkg && strcmp(pd->name, pkg) == 0)))
-            p = parse_omnils(pd->omnils, base, pkg, p);
-        pd = pd->next;
-    }
+    // Tell the client how to get the next page
+    char more[64];
+    if (compl_more > 0)
+        snprintf(more, 63, ", {more = %d, offset = %d}", compl_more,
+                 compl_offset + (max_compl > 0 ? max_compl : 0));
+    else
+        more[0] = 0;
+    compl_skip = 0;
 
     printf("\x11%" PRI_SIZET "\x11"
-           "lua %s(%s, {%s})\n",
-           strlen(compl_cb) + strlen(id) + strlen(compl_buffer) + 10, compl_cb,
-           id, compl_buffer);
+           "lua %s(%s, {%s}%s)\n",
+           strlen(compl_cb) + strlen(id) + strlen(compl_buffer) +
+               strlen(more) + 10,
+           compl_cb, id, compl_buffer, more);
     fflush(stdout);
+    LOG_TOUCHED("complete");
 }
 
 /*
  * TODO: Candidate for message_handling.c
  *
- * @desc: Used in main() for continuous processing of stdin commands
+ * @desc: Process a single command received from Neovim through stdin
+ * @param line: The command without the trailing new line
  */
-void stdin_loop(void) {
-    char line[1024];
+static void process_stdin_cmd(char *line) {
     FILE *f;
     char *msg;
     char t;
-    memset(line, 0, 1024);
-
-    while (fgets(line, 1023, stdin)) {
 
-        for (unsigned int i = 0; i < strlen(line); i++)
-            if (line[i] == '\n' || line[i] == '\r')
-                line[i] = 0;
-        Log("stdin:   %s", line);
-        msg = line;
+    Log("stdin:   %s", line);
+    msg = line;
+    switch (*msg) {
+    case '1': // Start server and wait nvimcom connection
+        start_server();
+        Log("server started");
+        break;
+    case '2': // Send message
+        msg++;
+        send_to_nvimcom(msg);
+        break;
+    case '3':
+        msg++;
         switch (*msg) {
-        case '1': // Start server and wait nvimcom connection
-            start_server();
-            Log("server started");
+        case '1': // Update GlobalEnv
+            auto_obbr = 1;
+            ob_shown = &ob_glbnv;
+            ob_forget(&ob_glbnv);
+            omni2ob();
             break;
-        case '2': // Send message
+        case '2': // Update Libraries
+            auto_obbr = 1;
+            ob_shown = &ob_libs;
+            ob_forget(&ob_libs);
+            lib2ob();
+            break;
+        case '3': // Open/Close list
+            msg++;
+            t = *msg;
             msg++;
-            send_to_nvimcom(msg);
+            toggle_list_status(msg);
+            if (t == 'G')
+                omni2ob();
+            else
+                lib2ob();
             break;
-        case '3':
+        case '4': // Close/Open all
             msg++;
-            switch (*msg) {
-            case '1': // Update GlobalEnv
-                auto_obbr = 1;
+            if (*msg == 'O')
+                change_all(listTree, 1);
+            else
+                change_all(listTree, 0);
+            msg++;
+            if (*msg == 'G')
                 omni2ob();
-                break;
-            case '2': // Update Libraries
-                auto_obbr = 1;
+            else
                 lib2ob();
-                break;
-            case '3': // Open/Close list
-                msg++;
-                t = *msg;
-                msg++;
-                toggle_list_status(msg);
-                if (t == 'G')
-                    omni2ob();
-                else
-                    lib2ob();
-                break;
-            case '4': // Close/Open all
-                msg++;
-                if (*msg == 'O')
-                    change_all(listTree, 1);
-                else
-                    change_all(listTree, 0);
-                msg++;
-                if (*msg == 'G')
-                    omni2ob();
-                else
-                    lib2ob();
-                break;
-            case '7':
-                f = fopen("/tmp/listTree", "w");
-                print_listTree(listTree, f);
-                fclose(f);
-                break;
-            }
             break;
-        case '4': // Miscellaneous commands
+        case '5': // Lines in view of a view, which might not be shown yet
             msg++;
-            switch (*msg) {
-            case '1':
-                read_args();
+            ObView *v = *msg == 'G' ? &ob_glbnv : &ob_libs;
+            v->top = strtol(msg + 1, &msg, 10);
+            v->bot = strtol(msg, NULL, 10);
+            if (v != ob_shown)
                 break;
-            case '2':
-                send_nrs_info();
-                break;
-            case '3':
-                update_glblenv_buffer("");
-                if (auto_obbr)
-                    omni2ob();
-                break;
-            }
+            if (v->ix.n > 0)
+                ob_render(v, &v->ix);
+            else if (v == &ob_glbnv)
+                omni2ob();
+            else
+                lib2ob();
+            break;
+        case '7':
+            f = fopen("/tmp/listTree", "w");
+            print_listTree(listTree, f);
+            fclose(f);
             break;
-        case '5':
+        }
+        break;
+    case '4': // Miscellaneous commands
+        msg++;
+        switch (*msg) {
+        case '1': // The args_ files were built
+            // They are mapped again when needed (see map_pkg_args())
+            for (PkgData *pd = pkgList; pd; pd = pd->next)
+                unmap_pkg_args(pd);
+            break;
+        case '2':
+            send_nrs_info();
+            break;
+        case '3':
+            update_glblenv_buffer("");
+            if (auto_obbr)
+                omni2ob();
+            break;
+#ifndef WIN32
+        case '4': // Build args_ files
+            build_args(msg + 1);
+            break;
+        case '5': // Packages referenced in the buffers being edited
+            set_buf_libs(msg + 1);
+            break;
+#endif
+        }
+        break;
+    case '5':
+        msg++;
+        char *id = msg;
+        while (*msg != '\003')
             msg++;
-            char *id = msg;
-            while (*msg != '\003')
-                msg++;
-            *msg = 0;
+        *msg = 0;
+        msg++;
+        // Request for the next page: 5<id>\003\b<offset>\b<base>
+        compl_offset = 0;
+        if (*msg == '\b') {
             msg++;
-            if (*msg == '\004') {
-                msg++;
-                complete(id, msg, "\004", NULL);
-            } else if (*msg == '\005') {
+            compl_offset = atoi(msg);
+            while (*msg && *msg != '\b')
                 msg++;
-                char *base = msg;
-                while (*msg != '\005')
-                    msg++;
-                *msg = 0;
+            if (*msg)
                 msg++;
-                complete(id, base, msg, NULL);
-            } else {
-                complete(id, msg, NULL, NULL);
-            }
-            break;
-        case '6':
+        }
+        compl_skip = compl_offset;
+        if (*msg == '\004') {
             msg++;
-            char *wrd = msg;
-            while (*msg != '\002')
-                msg++;
-            *msg = 0;
+            complete(id, msg, "\004", NULL);
+        } else if (*msg == '\007') { // Fuzzy completion
             msg++;
-            if (strstr(wrd, "::"))
-                wrd = strstr(wrd, "::") + 2;
-            completion_info(wrd, msg);
-            break;
-        case '7':
+            complete_fuzzy(id, msg);
+        } else if (*msg == '\005') {
             msg++;
-            char *p = msg;
-            while (*msg != '\002')
+            char *base = msg;
+            while (*msg != '\005')
                 msg++;
             *msg = 0;
             msg++;
-            char *f = msg;
-            while (*msg != '\002')
-                msg++;
-            *msg = 0;
+            complete(id, base, msg, NULL);
+        } else {
+            complete(id, msg, NULL, NULL);
+        }
+        break;
+    case '6':
+        msg++;
+        char *wrd = msg;
+        while (*msg != '\002')
             msg++;
-            resolve_arg_item(p, f, msg);
-            break;
-#ifdef WIN32
-        case '8':
-            // Messages related with the Rgui on Windows
+        *msg = 0;
+        msg++;
+        if (strstr(wrd, "::"))
+            wrd = strstr(wrd, "::") + 2;
+        completion_info(wrd, msg);
+        break;
+    case '7':
+        msg++;
+        char *p = msg;
+        while (*msg != '\002')
             msg++;
-            switch (*msg) {
-            case '1': // Check if R is running
-                if (PostMessage(RConsole, WM_NULL, 0, 0)) {
-                    fprintf(stderr, "R was already started\n");
-                    fflush(stderr);
-                } else {
-                    printf("lua require('r.windows').clean_and_start_Rgui()\n");
-                    fflush(stdout);
-                }
-                break;
-            case '3': // SendToRConsole
-                msg++;
-                SendToRConsole(msg);
-                break;
-            case '4': // SaveWinPos
-                msg++;
-                SaveWinPos(msg);
-                break;
-            case '5': // ArrangeWindows
-                msg++;
-                ArrangeWindows(msg);
-                break;
-            case '6':
-                RClearConsole();
-                break;
-            case '7': // RaiseNvimWindow
-                if (NvimHwnd)
-                    SetForegroundWindow(NvimHwnd);
-                break;
+        *msg = 0;
+        msg++;
+        char *f = msg;
+        while (*msg != '\002')
+            msg++;
+        *msg = 0;
+        msg++;
+        resolve_arg_item(p, f, msg);
+        break;
+#ifdef WIN32
+    case '8':
+        // Messages related with the Rgui on Windows
+        msg++;
+        switch (*msg) {
+        case '1': // Check if R is running
+            if (PostMessage(RConsole, WM_NULL, 0, 0)) {
+                fprintf(stderr, "R was already started\n");
+                fflush(stderr);
+            } else {
+                printf("lua require('r.windows').clean_and_start_Rgui()\n");
+                fflush(stdout);
             }
             break;
-#endif
-        case '9': // Quit now
-            exit(0);
+        case '3': // SendToRConsole
+            msg++;
+            SendToRConsole(msg);
             break;
-        default:
-            fprintf(stderr, "Unknown command received: [%d] %s\n", line[0],
-                    msg);
-            fflush(stderr);
+        case '4': // SaveWinPos
+            msg++;
+            SaveWinPos(msg);
+            break;
+        case '5': // ArrangeWindows
+            msg++;
+            ArrangeWindows(msg);
+            break;
+        case '6':
+            RClearConsole();
+            break;
+        case '7': // RaiseNvimWindow
+            if (NvimHwnd)
+                SetForegroundWindow(NvimHwnd);
             break;
         }
+        break;
+#endif
+    case '9': // Quit now
+        exit(0);
+        break;
+    default:
+        fprintf(stderr, "Unknown command received: [%d] %s\n", line[0], msg);
+        fflush(stderr);
+        break;
+    }
+}
+
+#ifdef WIN32
+/*
+ * @desc: Used in main() for continuous processing of stdin commands. On
+ * Windows, messages from nvimcom are received in a separate thread.
+ */
+void stdin_loop(void) {
+    char line[1024];
+    memset(line, 0, 1024);
+
+    while (fgets(line, 1023, stdin)) {
+        for (unsigned int i = 0; i < strlen(line); i++)
+            if (line[i] == '\n' || line[i] == '\r')
+                line[i] = 0;
+        process_stdin_cmd(line);
         memset(line, 0, 1024);
     }
 }
+#else
+/*
+ * @desc: Read all available data from stdin and process each complete line.
+ * @return 0 if stdin was closed and 1 otherwise.
+ */
+static int read_stdin(void) {
+    static char *ibuf;
+    static size_t ibuf_sz = 1024;
+    static size_t ibuf_len;
+
+    if (!ibuf)
+        ibuf = malloc(ibuf_sz * sizeof(char));
+    if (ibuf_sz - ibuf_len < 512) {
+        ibuf_sz *= 2;
+        ibuf = realloc(ibuf, ibuf_sz * sizeof(char));
+    }
+
+    ssize_t n = read(STDIN_FILENO, ibuf + ibuf_len, ibuf_sz - ibuf_len - 1);
+    if (n <= 0)
+        return 0;
+    ibuf_len += n;
+    ibuf[ibuf_len] = 0;
+
+    char *s = ibuf;
+    char *e;
+    while ((e = memchr(s, '\n', ibuf_len - (s - ibuf)))) {
+        *e = 0;
+        if (e > s && *(e - 1) == '\r')
+            *(e - 1) = 0;
+        process_stdin_cmd(s);
+        s = e + 1;
+    }
+    ibuf_len -= s - ibuf;
+    memmove(ibuf, s, ibuf_len);
+    return 1;
+}
+
+/*
+ * @desc: Used in main() to process stdin commands, the TCP connection request
+ * and the messages from nvimcom in a single thread. Since nothing runs
+ * concurrently, the buffers and lists shared by the completion and Object
+ * Browser functions do not need locks.
+ *
+ * When there is data in more than one file descriptor, commands from Neovim
+ * are processed first because they are usually requests waiting for an
+ * immediate answer (completion, Object Browser), while messages from nvimcom
+ * (such as the list of objects in .GlobalEnv) only update cached data. The
+ * outputs of the R processes building omni lists are read last.
+ */
+void event_loop(void) {
+    struct pollfd *fds = NULL;
+    int fds_sz = 0;
+    int nfds;
+
+    for (;;) {
+        int nw = bol_wk ? build_workers : 0;
+        if (fds_sz < 2 + nw) {
+            fds_sz = 2 + nw;
+            fds = realloc(fds, fds_sz * sizeof(struct pollfd));
+        }
+
+        fds[0].fd = STDIN_FILENO;
+        fds[0].events = POLLIN;
+        nfds = 1;
+        if (r_conn) {
+            fds[nfds].fd = connfd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        } else if (sockfd > 0) {
+            fds[nfds].fd = sockfd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        int nconn = nfds;
+        for (int i = 0; i < nw; i++) {
+            fds[nfds].fd = bol_wk[i].f ? fileno(bol_wk[i].f) : -1;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "poll() failed: %s\n", strerror(errno));
+            fflush(stderr);
+            exit(5);
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            if (!read_stdin())
+                return;
+        }
+
+        if (nconn == 2 && fds[1].revents) {
+            if (r_conn) {
+                if (!receive_msg())
+                    close_connection();
+            } else {
+                accept_connection();
+            }
+        }
+
+        for (int i = 0; i < nw; i++)
+            if (fds[nconn + i].revents && bol_wk[i].f)
+                bol_worker_event(i);
+    }
+}
+#endif
 
 int main(int argc, char **argv) {
     init();
 #ifdef WIN32
     Windows_setup();
-#endif
     stdin_loop();
+#else
+    event_loop();
+#endif
     return 0;
 }
@@ -0,0 +1,212 @@
+#include "scan.h"
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+// State of the scan of omnils_ lines between blocks of bytes
+typedef struct scan_state_ {
+    long nl;       // Number of lines already scanned
+    int nsep;      // Number of separators in the current line
+    size_t bad;    // Position following the newline of an invalid line
+} ScanState;
+
+/**
+ * @brief Scans bytes one by one, from i to len.
+ * @return 0 on success or -1 if a line does not have exactly 7 separators.
+ */
+static int scan_bytes(char *b, size_t i, size_t len, int convert,
+                      ScanState *st) {
+    for (; i < len; i++) {
+        switch (b[i]) {
+        case '\006':
+            if (convert)
+                b[i] = 0;
+            st->nsep++;
+            break;
+        case '\'':
+            if (convert)
+                b[i] = '\x13';
+            break;
+        case '\x12':
+            if (convert)
+                b[i] = '\'';
+            break;
+        case '\n':
+            if (st->nsep != 7) {
+                st->bad = i + 1;
+                return -1;
+            }
+            st->nsep = 0;
+            st->nl++;
+            break;
+        }
+    }
+    return 0;
+}
+
+static long scan_scalar(char *b, size_t len, int convert, size_t *bad) {
+    ScanState st = {0, 0, 0};
+    if (scan_bytes(b, 0, len, convert, &st)) {
+        *bad = st.bad;
+        return -1;
+    }
+    return st.nl;
+}
+
+#ifdef SCAN_X86
+/**
+ * @brief Counts the separators of each line ending in a block of bytes.
+ *
+ * @param sep Bit mask of the separators in the block.
+ * @param nl Bit mask of the newlines in the block.
+ * @param i Position of the block in the buffer.
+ * @return 0 on success or -1 if a line does not have exactly 7 separators.
+ */
+static int scan_masks(uint32_t sep, uint32_t nl, size_t i, ScanState *st) {
+    while (nl) {
+        int p = __builtin_ctz(nl);
+        uint32_t before = sep & ((2u << p) - 1);
+        st->nsep += __builtin_popcount(before);
+        sep &= ~before;
+        if (st->nsep != 7) {
+            st->bad = i + p + 1;
+            return -1;
+        }
+        st->nsep = 0;
+        st->nl++;
+        nl &= nl - 1;
+    }
+    st->nsep += __builtin_popcount(sep);
+    return 0;
+}
+
+__attribute__((target("sse2"))) static long
+scan_sse2(char *b, size_t len, int convert, size_t *bad) {
+    ScanState st = {0, 0, 0};
+    const __m128i v6 = _mm_set1_epi8('\006');
+    const __m128i vq = _mm_set1_epi8('\'');
+    const __m128i v12 = _mm_set1_epi8('\x12');
+    const __m128i vn = _mm_set1_epi8('\n');
+    const __m128i v13 = _mm_set1_epi8('\x13');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i m6 = _mm_cmpeq_epi8(x, v6);
+        __m128i mq = _mm_cmpeq_epi8(x, vq);
+        __m128i m12 = _mm_cmpeq_epi8(x, v12);
+        __m128i any = _mm_or_si128(m6, _mm_or_si128(mq, m12));
+        if (convert && _mm_movemask_epi8(any)) {
+            x = _mm_andnot_si128(any, x);
+            x = _mm_or_si128(x, _mm_and_si128(mq, v13));
+            x = _mm_or_si128(x, _mm_and_si128(m12, vq));
+            _mm_storeu_si128((__m128i *)(b + i), x);
+        }
+        if (scan_masks(_mm_movemask_epi8(m6),
+                       _mm_movemask_epi8(_mm_cmpeq_epi8(x, vn)), i, &st)) {
+            *bad = st.bad;
+            return -1;
+        }
+    }
+    if (scan_bytes(b, i, len, convert, &st)) {
+        *bad = st.bad;
+        return -1;
+    }
+    return st.nl;
+}
+
+__attribute__((target("avx2"))) static long
+scan_avx2(char *b, size_t len, int convert, size_t *bad) {
+    ScanState st = {0, 0, 0};
+    const __m256i v6 = _mm256_set1_epi8('\006');
+    const __m256i vq = _mm256_set1_epi8('\'');
+    const __m256i v12 = _mm256_set1_epi8('\x12');
+    const __m256i vn = _mm256_set1_epi8('\n');
+    const __m256i v13 = _mm256_set1_epi8('\x13');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i m6 = _mm256_cmpeq_epi8(x, v6);
+        __m256i mq = _mm256_cmpeq_epi8(x, vq);
+        __m256i m12 = _mm256_cmpeq_epi8(x, v12);
+        __m256i any = _mm256_or_si256(m6, _mm256_or_si256(mq, m12));
+        if (convert && _mm256_movemask_epi8(any)) {
+            x = _mm256_andnot_si256(any, x);
+            x = _mm256_or_si256(x, _mm256_and_si256(mq, v13));
+            x = _mm256_or_si256(x, _mm256_and_si256(m12, vq));
+            _mm256_storeu_si256((__m256i *)(b + i), x);
+        }
+        if (scan_masks(_mm256_movemask_epi8(m6),
+                       _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, vn)), i,
+                       &st)) {
+            *bad = st.bad;
+            return -1;
+        }
+    }
+    if (scan_bytes(b, i, len, convert, &st)) {
+        *bad = st.bad;
+        return -1;
+    }
+    return st.nl;
+}
+#endif
+
+static long (*scan_fn)(char *, size_t, int, size_t *);
+static const char *scan_name;
+
+static void scan_init(void) {
+    scan_fn = scan_scalar;
+    scan_name = "scalar";
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_fn = scan_avx2;
+        scan_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_fn = scan_sse2;
+        scan_name = "sse2";
+    }
+#endif
+}
+
+/**
+ * @brief Validates and converts omnils_ lines in one pass, using the widest
+ * vector instructions supported by the CPU.
+ *
+ * Each line must have exactly 7 '\006' separators. They are replaced with
+ * NULL bytes, single quotes with '\x13' and '\x12' with single quotes. Bytes
+ * after the last newline are converted but not validated.
+ *
+ * @param b The buffer.
+ * @param len Number of bytes in the buffer.
+ * @param bad Pointer to be set to the position following the newline of the
+ * first invalid line.
+ * @return The number of lines or -1 if a line is invalid. In this case, the
+ * buffer is only partially converted.
+ */
+long scan_omnils(char *b, size_t len, size_t *bad) {
+    if (!scan_fn)
+        scan_init();
+    return scan_fn(b, len, 1, bad);
+}
+
+/**
+ * @brief Validates omnils_ lines as scan_omnils() does, but without
+ * converting them, for buffers that must not be modified.
+ */
+long check_omnils_lines(const char *b, size_t len, size_t *bad) {
+    if (!scan_fn)
+        scan_init();
+    return scan_fn((char *)b, len, 0, bad);
+}
+
+/**
+ * @brief Returns the name of the kernel used by scan_omnils().
+ */
+const char *scan_kernel(void) {
+    if (!scan_fn)
+        scan_init();
+    return scan_name;
+}
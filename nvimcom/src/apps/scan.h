@@ -0,0 +1,10 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+long scan_omnils(char *b, size_t len, size_t *bad);
+long check_omnils_lines(const char *b, size_t len, size_t *bad);
+const char *scan_kernel(void);
+
+#endif // SCAN_H
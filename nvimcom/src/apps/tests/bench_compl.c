@@ -0,0 +1,159 @@
+#include "nrsdriver.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Latency of completion with 150 packages loaded.
+ *
+ * The benchmark loads 150 packages and completes bases of 1 to 3 characters
+ * taken from the names of their objects. It reports the p50 and p99 latency
+ * and the mean number of items for each length of the base.
+ *
+ * Usage: bench_compl [compldir]
+ *
+ * With a compldir, its first 150 omnils_ files (with their fun_ files) are
+ * linked into the temporary directory, so that the caches of real packages
+ * are used without changing them. Otherwise, synthetic ones of 30 to 3300
+ * objects are created. Set RNVIM_MAX_COMPL to limit the number of items.
+ */
+
+#define N_PKGS 150
+#define N_QUERIES 1000
+
+static char *names[1000000];
+static int nnames;
+
+// Reads the names of the objects of an omnils_ file
+static void read_names(const char *fnm) {
+    FILE *f = fopen(fnm, "r");
+    char line[4096];
+    if (!f)
+        return;
+    while (fgets(line, sizeof(line), f) && nnames < 1000000) {
+        char *e = strchr(line, '\006');
+        if (e && e > line) {
+            *e = 0;
+            names[nnames++] = strdup(line);
+        }
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    char *pkgs[N_PKGS];
+    char fnm[1024], src[1024], cmd[128];
+    int npkgs = 0;
+    Nrs s;
+
+    nrs_mkdir(&s);
+    if (argc > 1) {
+        DIR *d = opendir(argv[1]);
+        struct dirent *e;
+        if (!d) {
+            perror(argv[1]);
+            return 1;
+        }
+        while ((e = readdir(d)) && npkgs < N_PKGS) {
+            if (strncmp(e->d_name, "omnils_", 7) != 0)
+                continue;
+            snprintf(src, 1023, "%s/fun_%s", argv[1], e->d_name + 7);
+            if (access(src, R_OK) != 0)
+                continue;
+            snprintf(fnm, 1023, "%s/compl/fun_%s", s.dir, e->d_name + 7);
+            if (symlink(src, fnm) != 0)
+                continue;
+            snprintf(src, 1023, "%s/%s", argv[1], e->d_name);
+            snprintf(fnm, 1023, "%s/compl/%s", s.dir, e->d_name);
+            if (symlink(src, fnm) != 0)
+                continue;
+            pkgs[npkgs++] = strdup(e->d_name + 7); // <pkg>_<version>
+        }
+        closedir(d);
+    } else {
+        srand(1);
+        for (int i = 0; i < N_PKGS; i++) {
+            char *b;
+            int n = 30 + (rand() % 1000) * (rand() % 1000) / 300;
+            char pkg[32];
+            snprintf(pkg, 31, "pkg%03d", i);
+            size_t len = fake_omnils(&b, pkg, n, i + 1);
+            snprintf(fnm, 1023, "%s/compl/omnils_%s_1.0", s.dir, pkg);
+            write_file(fnm, b, len);
+            snprintf(fnm, 1023, "%s/compl/fun_%s_1.0", s.dir, pkg);
+            write_file(fnm, "", 0);
+            free(b);
+            snprintf(fnm, 1023, "%s_1.0", pkg);
+            pkgs[npkgs++] = strdup(fnm);
+        }
+    }
+
+    // The +L message: name \003 version \004 for each package
+    size_t len = 2;
+    char *msg = malloc(npkgs * 300 + 8);
+    strcpy(msg, "+L");
+    for (int i = 0; i < npkgs; i++) {
+        char *v = strrchr(pkgs[i], '_');
+        snprintf(fnm, 1023, "%s/compl/omnils_%s", s.dir, pkgs[i]);
+        read_names(fnm);
+        len += sprintf(msg + len, "%.*s\003%s\004", (int)(v - pkgs[i]),
+                       pkgs[i], v + 1);
+    }
+    msg[len++] = '\n';
+    if (nnames == 0) {
+        fprintf(stderr, "bench_compl: no packages found\n");
+        return 1;
+    }
+
+    nrs_start(&s, NULL, 0);
+    nrs_connect(&s);
+    double t = nrs_now();
+    nrs_send(&s, msg, len);
+    // Wait until the name of the last object is completed
+    for (;;) {
+        int clen = snprintf(cmd, 127, "5 0\003%s", names[nnames - 1]);
+        nrs_cmd(&s, cmd, clen);
+        char *r = nrs_readline(&s, 600000);
+        if (!r || nrs_now() - t > 600000) {
+            fprintf(stderr, "bench_compl: the packages were not loaded\n");
+            return 1;
+        }
+        if (strstr(r, "{word = "))
+            break;
+    }
+    printf("%d packages, %d objects, loaded in %.0f ms\n", npkgs, nnames,
+           nrs_now() - t);
+    nrs_drain(&s, 200);
+
+    printf("%5s %8s %10s %10s %10s\n", "base", "queries", "p50 (ms)",
+           "p99 (ms)", "items");
+    srand(2);
+    for (int k = 1; k <= 3; k++) {
+        double lat[N_QUERIES];
+        long items = 0;
+        for (int i = 0; i < N_QUERIES; i++) {
+            const char *nm = names[rand() % nnames];
+            int clen = snprintf(cmd, 127, "5 %d\003%.*s", i + 1, k, nm);
+            double t0 = nrs_now();
+            nrs_cmd(&s, cmd, clen);
+            char *r = nrs_readline(&s, 60000);
+            lat[i] = nrs_now() - t0;
+            if (!r) {
+                fprintf(stderr, "bench_compl: no reply to %s\n", cmd);
+                return 1;
+            }
+            for (char *p = r; (p = strstr(p, "{word = ")); p++)
+                items++;
+        }
+        qsort(lat, N_QUERIES, sizeof(double), cmp_double);
+        printf("%5d %8d %10.3f %10.3f %10ld\n", k, N_QUERIES,
+               lat[N_QUERIES / 2], lat[N_QUERIES * 99 / 100],
+               items / N_QUERIES);
+    }
+
+    nrs_stop(&s);
+    nrs_cleanup(&s);
+    return 0;
+}
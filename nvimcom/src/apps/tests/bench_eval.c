@@ -0,0 +1,92 @@
+#include "nrsdriver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/*
+ * Round-trip latency of an `E` (evaluate) message through a Unix socket and
+ * through TCP on the loopback interface.
+ *
+ * The benchmark plays Neovim, which writes "2E<id><code>" to the stdin of
+ * rnvimserver, and nvimcom, which receives "E<id><code>" on the socket and
+ * replies with a Lua command for rnvimserver to write to stdout. R itself
+ * is not involved, so only the transport and rnvimserver are measured.
+ *
+ * Usage: bench_eval [n]
+ */
+
+static int wait_eval(Nrs *s, const char *code) {
+    static char buf[4096];
+    static size_t len;
+    for (;;) {
+        buf[len] = 0;
+        if (strstr(buf, code)) {
+            len = 0;
+            return 1;
+        }
+        if (len == sizeof(buf) - 1)
+            len = 0;
+        ssize_t r = recv(s->sock, buf + len, sizeof(buf) - 1 - len, 0);
+        if (r <= 0)
+            return 0;
+        // Each message ends with a NULL byte
+        for (ssize_t i = 0; i < r; i++)
+            if (buf[len + i] == 0)
+                buf[len + i] = '\n';
+        len += r;
+    }
+}
+
+static void run(int unix_socket, int n) {
+    char cmd[128], code[64], reply[64];
+    double *lat = malloc(n * sizeof(double));
+    Nrs s;
+
+    nrs_mkdir(&s);
+    nrs_start(&s, NULL, unix_socket);
+    nrs_connect(&s);
+    nrs_drain(&s, 200);
+
+    for (int i = -100; i < n; i++) { // The first 100 are a warm-up
+        int k = i < 0 ? -i : i;
+        snprintf(code, 63, "nvimcom:::nvim_eval(%d)", k);
+        int clen = snprintf(cmd, 127, "2E77%s", code);
+        int rlen = snprintf(reply, 63, "lua pong(%d)", k);
+        double t = nrs_now();
+        nrs_cmd(&s, cmd, clen);
+        if (!wait_eval(&s, code)) {
+            fprintf(stderr, "bench_eval: connection closed\n");
+            exit(1);
+        }
+        nrs_send(&s, reply, rlen);
+        if (!nrs_wait_for(&s, reply, 5000)) {
+            fprintf(stderr, "bench_eval: no reply\n");
+            exit(1);
+        }
+        if (i >= 0)
+            lat[i] = (nrs_now() - t) * 1000;
+    }
+    nrs_stop(&s);
+    nrs_cleanup(&s);
+
+    qsort(lat, n, sizeof(double), cmp_double);
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += lat[i];
+    printf("%-12s %8.1f %8.1f %8.1f %8.1f\n",
+           unix_socket ? "Unix socket" : "TCP", sum / n, lat[n / 2],
+           lat[n * 99 / 100], lat[n - 1]);
+    free(lat);
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+    if (n < 1)
+        n = 1;
+    printf("%d round trips (us)\n%-12s %8s %8s %8s %8s\n", n, "", "mean",
+           "p50", "p99", "max");
+    run(0, n);
+    run(1, n);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "../data_structures.c"
+#include "nrsdriver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Speed of ListStatusTable with 100k paths of the Object Browser.
+ *
+ * The paths are those of 100 libraries ("pkgNNN:") and of 1000 objects with
+ * 99 list elements each, in sorted order, as the Object Browser adds them.
+ * The benchmark times, for the best of 5 runs:
+ *
+ *   - Inserting all paths as get_list_status() does for new ones: a failed
+ *     lookup followed by list_status_add().
+ *   - Looking up all paths, as get_list_status() does for known ones.
+ *   - Walking the entries in insertion order, as change_all() does.
+ */
+
+#define N_PATHS 100000
+#define N_RUNS 5
+
+int main(void) {
+    static char keys[N_PATHS][40];
+    double best[3] = {1e9, 1e9, 1e9};
+    long found = 0;
+
+    int n = 0;
+    for (int l = 0; l < 100; l++)
+        sprintf(keys[n++], "pkg%03d:", l);
+    for (int o = 0; n < N_PATHS; o++) {
+        sprintf(keys[n++], ".GlobalEnv-obj%04d", o);
+        for (int e = 0; e < 99 && n < N_PATHS; e++)
+            sprintf(keys[n++], ".GlobalEnv-obj%04d$el%03d", o, e);
+    }
+
+    for (int r = 0; r < N_RUNS; r++) {
+        ListStatusTable *t = new_ListStatusTable();
+        double t0 = nrs_now();
+        for (int i = 0; i < n; i++)
+            if (!list_status_get(t, keys[i]))
+                list_status_add(t, keys[i], 0);
+        double t1 = nrs_now();
+        for (int i = 0; i < n; i++)
+            found += list_status_get(t, keys[i]) != NULL;
+        double t2 = nrs_now();
+        for (unsigned int i = 0; i < t->n; i++) {
+            ListStatus *p = list_status_at(t, i);
+            if (p->key[strlen(p->key) - 1] != ':')
+                p->status = 1;
+        }
+        double t3 = nrs_now();
+        double d[3] = {t1 - t0, t2 - t1, t3 - t2};
+        for (int k = 0; k < 3; k++)
+            if (d[k] < best[k])
+                best[k] = d[k];
+        // The table has no destructor: its memory is left to the process
+    }
+    if (found != (long)n * N_RUNS) {
+        fprintf(stderr, "bench_liststatus: paths not found\n");
+        return 1;
+    }
+
+    printf("%d paths, best of %d runs\n", n, N_RUNS);
+    printf("  %-12s %8.2f ms %8.1f ns/path\n", "insert all", best[0],
+           best[0] * 1e6 / n);
+    printf("  %-12s %8.2f ms %8.1f ns/path\n", "lookup all", best[1],
+           best[1] * 1e6 / n);
+    printf("  %-12s %8.2f ms %8.1f ns/path\n", "change_all", best[2],
+           best[2] * 1e6 / n);
+    return 0;
+}
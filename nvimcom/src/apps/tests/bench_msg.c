@@ -0,0 +1,67 @@
+#include "nrsdriver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Throughput and latency of the messages that nvimcom sends to rnvimserver.
+ *
+ * For each payload size from 1 KB to 64 MB, the benchmark sends messages
+ * whose body is "+Z" followed by the payload. rnvimserver reads the whole
+ * message with get_whole_msg() and ParseMsg() ignores it, so only the
+ * reading is measured. Each one is followed by a short Lua command that
+ * rnvimserver writes to stdout, and the latency of a message is the time
+ * from the start of its sending until that command arrives.
+ *
+ * Usage: bench_msg [tcp|unix]
+ * Set RNVIMSERVER to benchmark another build of rnvimserver.
+ */
+
+int main(int argc, char **argv) {
+    int unix_socket = argc > 1 && strcmp(argv[1], "unix") == 0;
+    const size_t max_size = (size_t)64 << 20;
+    char *msg = malloc(max_size + 3);
+    Nrs s;
+
+    memcpy(msg, "+Z", 2);
+    memset(msg + 2, 'x', max_size);
+
+    nrs_mkdir(&s);
+    nrs_start(&s, NULL, unix_socket);
+    nrs_connect(&s);
+    nrs_drain(&s, 200);
+
+    printf("%s\n%10s %6s %10s %10s %10s\n",
+           unix_socket ? "Unix socket" : "TCP", "size", "n", "MB/s",
+           "p50 (ms)", "p99 (ms)");
+    for (size_t size = 1024; size <= max_size; size *= 4) {
+        int n = (int)(((size_t)256 << 20) / size);
+        if (n > 1000)
+            n = 1000;
+        if (n < 3)
+            n = 3;
+        double *lat = malloc(n * sizeof(double));
+        double t0 = nrs_now();
+        for (int i = 0; i < n; i++) {
+            double t = nrs_now();
+            nrs_send(&s, msg, size + 2);
+            nrs_send(&s, "lua ping()", 10);
+            if (!nrs_wait_for(&s, "ping()", 60000)) {
+                fprintf(stderr, "bench_msg: no reply for %zu bytes\n", size);
+                return 1;
+            }
+            lat[i] = nrs_now() - t;
+        }
+        double total = nrs_now() - t0;
+        qsort(lat, n, sizeof(double), cmp_double);
+        printf("%10zu %6d %10.1f %10.3f %10.3f\n", size, n,
+               (double)size * n / (1 << 20) / (total / 1000), lat[n / 2],
+               lat[n * 99 / 100]);
+        free(lat);
+    }
+
+    nrs_stop(&s);
+    nrs_cleanup(&s);
+    free(msg);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "../scan.c" // The kernels are static
+#include "nrsdriver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Speed of the kernels of scan.c on omnils_ files.
+ *
+ * Usage: bench_scan [omnils_file ...]
+ *
+ * Without arguments, a synthetic file of 200000 objects (about 18 MB) is
+ * used. Real files can be found in the compldir of R.nvim (by default
+ * ~/.cache/R.nvim). For each kernel, the best of 15 runs is reported, when
+ * converting the buffer (scan_omnils()) and when only checking it
+ * (check_omnils_lines()).
+ */
+
+typedef long (*ScanFn)(char *, size_t, int, size_t *);
+
+static void bench(const char *fname, const char *src, size_t len) {
+    ScanFn fns[3] = {scan_scalar, NULL, NULL};
+    const char *names[3] = {"scalar", "sse2", "avx2"};
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        fns[1] = scan_sse2;
+    if (__builtin_cpu_supports("avx2"))
+        fns[2] = scan_avx2;
+#endif
+    char *w = malloc(len + 1);
+    char *ref = malloc(len + 1);
+    size_t bad = 0;
+    memcpy(ref, src, len);
+    long nl = scan_scalar(ref, len, 1, &bad);
+    printf("%s: %.1f MB, %ld lines%s\n", fname, len / 1e6, nl,
+           nl < 0 ? " (invalid)" : "");
+
+    for (int k = 0; k < 3; k++) {
+        if (!fns[k])
+            continue;
+        double best[2] = {1e9, 1e9};
+        int same = 1;
+        for (int convert = 0; convert < 2; convert++) {
+            for (int r = 0; r < 15; r++) {
+                memcpy(w, src, len);
+                double t0 = nrs_now();
+                long n = fns[k](w, len, convert, &bad);
+                double t = nrs_now() - t0;
+                if (t < best[convert])
+                    best[convert] = t;
+                if (n != nl || (convert && nl >= 0 && memcmp(w, ref, len)))
+                    same = 0;
+            }
+        }
+        printf("  %-6s  convert %7.2f ms %6.2f GB/s   check %7.2f ms "
+               "%6.2f GB/s  %s\n",
+               names[k], best[1], len / best[1] / 1e6, best[0],
+               len / best[0] / 1e6, same ? "" : "MISMATCH");
+    }
+    free(w);
+    free(ref);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        char *b;
+        size_t len = fake_omnils(&b, "synthetic", 200000, 1);
+        bench("synthetic", b, len);
+        free(b);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            perror(argv[i]);
+            continue;
+        }
+        fseek(f, 0, SEEK_END);
+        size_t len = ftell(f);
+        rewind(f);
+        char *b = malloc(len + 1);
+        if (fread(b, 1, len, f) == len)
+            bench(argv[i], b, len);
+        fclose(f);
+        free(b);
+    }
+    return 0;
+}
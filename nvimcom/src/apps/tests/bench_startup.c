@@ -0,0 +1,142 @@
+#include "nrsdriver.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Time to load 200 packages from their omnils_ files and from their compl_
+ * files.
+ *
+ * Each run starts rnvimserver and sends the +L message with the 200 packages.
+ * The time is taken until rnvimserver asks Neovim to update the syntax, after
+ * loading all packages (see finish_bol()). Without compl_ files, rnvimserver
+ * validates and indexes the omnils_ files, and writes the compl_ files, which
+ * the next run maps. The median and the best of the runs are reported for
+ * both. A fake R answers the requests to build the cache files, which are up
+ * to date, so that starting R is not measured.
+ *
+ * Usage: bench_startup [compldir]
+ *
+ * With a compldir, its first 200 omnils_ files (with their fun_ files) are
+ * linked into the temporary directory, as in bench_compl. The compl_ files
+ * are written in the temporary directory, not in the compldir.
+ */
+
+#define N_PKGS 200
+#define N_RUNS 7
+
+static char *pkgs[N_PKGS];
+static int npkgs;
+
+// Removes the compl_ files of the temporary directory
+static void remove_compl(Nrs *s) {
+    char fnm[1024];
+    for (int i = 0; i < npkgs; i++) {
+        snprintf(fnm, 1023, "%s/compl/compl_%s", s->dir, pkgs[i]);
+        remove(fnm);
+    }
+}
+
+// Returns the time from the +L message to the end of the loading
+static double run(Nrs *s, const char *msg, size_t len) {
+    nrs_start(s, NULL, 0);
+    nrs_connect(s);
+    double t = nrs_now();
+    nrs_send(s, msg, len);
+    if (!nrs_wait_for(s, "update_Rhelp_list()", 600000)) {
+        fprintf(stderr, "bench_startup: the packages were not loaded\n");
+        exit(1);
+    }
+    t = nrs_now() - t;
+    nrs_stop(s);
+    return t;
+}
+
+int main(int argc, char **argv) {
+    char fnm[1024], src[1024];
+    long long bytes = 0;
+    Nrs s;
+
+    nrs_mkdir(&s);
+    nrs_fake_r(&s);
+    if (argc > 1) {
+        DIR *d = opendir(argv[1]);
+        struct dirent *e;
+        if (!d) {
+            perror(argv[1]);
+            return 1;
+        }
+        while ((e = readdir(d)) && npkgs < N_PKGS) {
+            if (strncmp(e->d_name, "omnils_", 7) != 0)
+                continue;
+            snprintf(src, 1023, "%s/fun_%s", argv[1], e->d_name + 7);
+            if (access(src, R_OK) != 0)
+                continue;
+            snprintf(fnm, 1023, "%s/compl/fun_%s", s.dir, e->d_name + 7);
+            if (symlink(src, fnm) != 0)
+                continue;
+            snprintf(src, 1023, "%s/%s", argv[1], e->d_name);
+            snprintf(fnm, 1023, "%s/compl/%s", s.dir, e->d_name);
+            if (symlink(src, fnm) != 0)
+                continue;
+            pkgs[npkgs++] = strdup(e->d_name + 7); // <pkg>_<version>
+        }
+        closedir(d);
+    } else {
+        srand(1);
+        for (int i = 0; i < N_PKGS; i++) {
+            char *b;
+            int n = 30 + (rand() % 1000) * (rand() % 1000) / 300;
+            char pkg[32];
+            snprintf(pkg, 31, "pkg%03d", i);
+            size_t len = fake_omnils(&b, pkg, n, i + 1);
+            snprintf(fnm, 1023, "%s/compl/omnils_%s_1.0", s.dir, pkg);
+            write_file(fnm, b, len);
+            snprintf(fnm, 1023, "%s/compl/fun_%s_1.0", s.dir, pkg);
+            write_file(fnm, "", 0);
+            free(b);
+            snprintf(fnm, 1023, "%s_1.0", pkg);
+            pkgs[npkgs++] = strdup(fnm);
+        }
+    }
+
+    // The +L message, and the size of the omnils_ files
+    size_t len = 2;
+    char *msg = malloc(npkgs * 300 + 8);
+    strcpy(msg, "+L");
+    for (int i = 0; i < npkgs; i++) {
+        struct stat st;
+        char *v = strrchr(pkgs[i], '_');
+        len += sprintf(msg + len, "%.*s\003%s\004", (int)(v - pkgs[i]),
+                       pkgs[i], v + 1);
+        snprintf(fnm, 1023, "%s/compl/omnils_%s", s.dir, pkgs[i]);
+        if (stat(fnm, &st) == 0)
+            bytes += st.st_size;
+    }
+    msg[len++] = '\n';
+    if (npkgs == 0) {
+        fprintf(stderr, "bench_startup: no packages found\n");
+        return 1;
+    }
+
+    printf("%d packages, %.1f MB of omnils_ files, %d runs\n", npkgs,
+           bytes / 1e6, N_RUNS);
+    printf("%-8s %10s %10s\n", "from", "p50 (ms)", "best (ms)");
+    double t[2][N_RUNS];
+    for (int i = 0; i < N_RUNS; i++) {
+        remove_compl(&s);
+        t[0][i] = run(&s, msg, len);
+        t[1][i] = run(&s, msg, len);
+    }
+    const char *from[2] = {"omnils_", "compl_"};
+    for (int k = 0; k < 2; k++) {
+        qsort(t[k], N_RUNS, sizeof(double), cmp_double);
+        printf("%-8s %10.1f %10.1f\n", from[k], t[k][N_RUNS / 2], t[k][0]);
+    }
+
+    nrs_cleanup(&s);
+    return 0;
+}
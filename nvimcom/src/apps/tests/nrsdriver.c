@@ -0,0 +1,425 @@
+#include "nrsdriver.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Helpers shared by the tests and benchmarks of rnvimserver. Each one starts
+ * ../rnvimserver in a temporary directory, with the environment variables
+ * that R.nvim would set, and talks to it as Neovim through its stdin and
+ * stdout and as nvimcom through the socket. Any failure is fatal.
+ */
+
+#define SECRET "12345"
+
+static pid_t child; // rnvimserver to be killed if the driver fails
+
+static void kill_child(void) {
+    if (child > 0)
+        kill(child, SIGKILL);
+}
+
+static void die(const char *what) {
+    fprintf(stderr, "nrsdriver: %s: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+/**
+ * @brief Returns a monotonic time in milliseconds.
+ */
+double nrs_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void write_file(const char *fname, const char *s, size_t len) {
+    FILE *f = fopen(fname, "w");
+    if (!f)
+        die(fname);
+    if (len && fwrite(s, 1, len, f) != len)
+        die(fname);
+    fclose(f);
+}
+
+/**
+ * @brief Creates the temporary directory of an rnvimserver.
+ *
+ * The directory has the subdirectories tmp/ (RNVIM_TMPDIR) and compl/
+ * (the default RNVIM_COMPLDIR). Tests that need omnils_ files create them
+ * in compl/ before calling nrs_start().
+ */
+void nrs_mkdir(Nrs *s) {
+    char b[512];
+    memset(s, 0, sizeof(Nrs));
+    s->sock = -1;
+    strcpy(s->dir, "/tmp/nrstest_XXXXXX");
+    if (!mkdtemp(s->dir))
+        die("mkdtemp");
+    snprintf(b, 511, "%s/tmp", s->dir);
+    mkdir(b, 0700);
+    snprintf(b, 511, "%s/compl", s->dir);
+    mkdir(b, 0700);
+    snprintf(b, 511, "%s/tmp/libPaths", s->dir);
+    write_file(b, "/nonexistent\n", 13);
+    snprintf(b, 511, "%s/tmp/libnames_77", s->dir);
+    write_file(b, "", 0);
+}
+
+/**
+ * @brief Makes rnvimserver run a fake R instead of /bin/false.
+ *
+ * The script plays nvimcom:::nvim.buildhelper() when the cache files are up
+ * to date: it replies to each request at once without building anything.
+ * With /bin/false, each request starts a process that fails.
+ */
+void nrs_fake_r(Nrs *s) {
+    static const char script[] =
+        "#!/bin/sh\n"
+        "while IFS='\t' read -r k p a; do\n"
+        "    if [ \"$k\" = O ]; then c='\\002'; else c='\\003'; fi\n"
+        "    printf \"$c%s\\n\" \"$p\"\n"
+        "done\n";
+    snprintf(s->rpath, sizeof(s->rpath), "%s/fake_R", s->dir);
+    write_file(s->rpath, script, sizeof(script) - 1);
+    if (chmod(s->rpath, 0700) != 0)
+        die(s->rpath);
+}
+
+/**
+ * @brief Starts rnvimserver.
+ *
+ * @param s The driver, already prepared by nrs_mkdir().
+ * @param compldir The compldir or NULL to use the compl/ subdirectory.
+ * @param unix_socket Whether nvimcom should connect through a Unix socket.
+ */
+void nrs_start(Nrs *s, const char *compldir, int unix_socket) {
+    char b[512];
+    int pin[2], pout[2];
+
+    if (pipe(pin) || pipe(pout))
+        die("pipe");
+    s->pid = fork();
+    if (s->pid < 0)
+        die("fork");
+    if (s->pid == 0) {
+        dup2(pin[0], 0);
+        dup2(pout[1], 1);
+        close(pin[1]);
+        close(pout[0]);
+        setenv("RNVIM_SECRET", SECRET, 1);
+        setenv("RNVIM_COMPLCB", "cb", 1);
+        setenv("RNVIM_COMPLInfo", "ci", 1);
+        setenv("RNVIM_ID", "77", 1);
+        setenv("RNVIM_RPATH", s->rpath[0] ? s->rpath : "/bin/false", 1);
+        snprintf(b, 511, "%s/tmp", s->dir);
+        setenv("RNVIM_TMPDIR", b, 1);
+        setenv("RNVIM_REMOTE_TMPDIR", b, 1);
+        unsetenv("RNVIM_LOCAL_TMPDIR");
+        if (compldir) {
+            setenv("RNVIM_COMPLDIR", compldir, 1);
+        } else {
+            snprintf(b, 511, "%s/compl", s->dir);
+            setenv("RNVIM_COMPLDIR", b, 1);
+        }
+        setenv("RNVIM_REMOTE_COMPLDIR", getenv("RNVIM_COMPLDIR"), 1);
+        if (unix_socket)
+            setenv("RNVIM_UNIX_SOCKET", "1", 1);
+        else
+            unsetenv("RNVIM_UNIX_SOCKET");
+        // Run in the temporary directory, so that the obstatus_ file of
+        // the project does not depend on where the test was started.
+        if (chdir(s->dir) != 0)
+            _exit(1);
+        const char *bin = getenv("RNVIMSERVER");
+        if (!bin)
+            bin = RNVIMSERVER;
+        execl(bin, bin, (char *)NULL);
+        _exit(127);
+    }
+    static int registered;
+    if (!registered)
+        atexit(kill_child);
+    registered = 1;
+    child = s->pid;
+    close(pin[0]);
+    close(pout[1]);
+    s->in = pin[1];
+    s->out = pout[0];
+    signal(SIGPIPE, SIG_IGN);
+}
+
+/**
+ * @brief Writes a command to the stdin of rnvimserver.
+ *
+ * @param cmd The command, without the final new line.
+ * @param len Its length.
+ */
+void nrs_cmd(Nrs *s, const char *cmd, size_t len) {
+    char *b = malloc(len + 1);
+    memcpy(b, cmd, len);
+    b[len] = '\n';
+    size_t done = 0;
+    while (done < len + 1) {
+        ssize_t w = write(s->in, b + done, len + 1 - done);
+        if (w < 0 && errno != EINTR)
+            die("write to stdin");
+        if (w > 0)
+            done += w;
+    }
+    free(b);
+}
+
+/**
+ * @brief Reads the next line of the stdout of rnvimserver.
+ *
+ * @param timeout_ms How long to wait for a complete line.
+ * @return The line, without the new line, valid until the next call, or
+ * NULL on timeout or end of file.
+ */
+char *nrs_readline(Nrs *s, int timeout_ms) {
+    static char *line;
+    static size_t line_size;
+    double end = nrs_now() + timeout_ms;
+    char *nl;
+
+    while (!(nl = memchr(s->obuf, '\n', s->olen))) {
+        int left = (int)(end - nrs_now());
+        if (left <= 0)
+            return NULL;
+        struct pollfd pfd = {s->out, POLLIN, 0};
+        if (poll(&pfd, 1, left) <= 0)
+            continue;
+        if (s->osize - s->olen < 65536) {
+            s->osize = s->osize ? 2 * s->osize : 1 << 20;
+            s->obuf = realloc(s->obuf, s->osize);
+        }
+        ssize_t r = read(s->out, s->obuf + s->olen, s->osize - s->olen);
+        if (r <= 0)
+            return NULL;
+        s->olen += r;
+    }
+
+    size_t n = nl - s->obuf;
+    if (n + 1 > line_size) {
+        line_size = n + 1;
+        line = realloc(line, line_size);
+    }
+    memcpy(line, s->obuf, n);
+    line[n] = 0;
+    s->olen -= n + 1;
+    memmove(s->obuf, nl + 1, s->olen);
+    return line;
+}
+
+/**
+ * @brief Reads lines until one contains str.
+ *
+ * @return The line or NULL on timeout.
+ */
+char *nrs_wait_for(Nrs *s, const char *str, int timeout_ms) {
+    double end = nrs_now() + timeout_ms;
+    char *l;
+    while ((l = nrs_readline(s, (int)(end - nrs_now()) + 1)))
+        if (strstr(l, str))
+            return l;
+    return NULL;
+}
+
+/**
+ * @brief Discards the output until none arrives for quiet_ms.
+ */
+void nrs_drain(Nrs *s, int quiet_ms) {
+    while (nrs_readline(s, quiet_ms))
+        ;
+}
+
+/**
+ * @brief Starts the server of rnvimserver and connects to it as nvimcom.
+ */
+void nrs_connect(Nrs *s) {
+    char *l, *p, *q;
+
+    nrs_cmd(s, "1", 1);
+    while ((l = nrs_readline(s, 5000))) {
+        if ((p = strstr(l, "set_nrs_socket('"))) {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            p += 16;
+            q = strchr(p, '\'');
+            if (!q || q - p >= (long)sizeof(addr.sun_path))
+                break;
+            memcpy(addr.sun_path, p, q - p);
+            s->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (connect(s->sock, (struct sockaddr *)&addr, sizeof(addr)))
+                die("connect to the Unix socket");
+            return;
+        }
+        if ((p = strstr(l, "set_nrs_port('"))) {
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(atoi(p + 14));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            // Older versions report the port before listening on it
+            for (int i = 0; i < 100; i++) {
+                s->sock = socket(AF_INET, SOCK_STREAM, 0);
+                if (!connect(s->sock, (struct sockaddr *)&addr,
+                             sizeof(addr))) {
+                    // As nvimcom_connect() does
+                    int one = 1;
+                    setsockopt(s->sock, IPPROTO_TCP, TCP_NODELAY, &one,
+                               sizeof(one));
+                    return;
+                }
+                close(s->sock);
+                usleep(10000);
+            }
+            die("connect to the TCP port");
+        }
+    }
+    fprintf(stderr, "nrsdriver: rnvimserver did not report its address\n");
+    exit(1);
+}
+
+static void send_all(int fd, const char *b, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = send(fd, b + done, len - done, 0);
+        if (w < 0 && errno != EINTR)
+            die("send");
+        if (w > 0)
+            done += w;
+    }
+}
+
+/**
+ * @brief Sends a message to rnvimserver as nvimcom does.
+ *
+ * The message is framed by the secret, its size in 9 digits and a final
+ * '\x11'. As in send_to_nvim(), the three parts are sent separately.
+ */
+void nrs_send(Nrs *s, const char *body, size_t len) {
+    char head[32];
+    int hl = snprintf(head, 31, "%s%09zu", SECRET, len);
+    send_all(s->sock, head, hl);
+    send_all(s->sock, body, len);
+    send_all(s->sock, "\x11", 1);
+}
+
+/**
+ * @brief Stops rnvimserver.
+ *
+ * @return 0 if it quit normally when asked to, and 1 if it had crashed,
+ * failed or had to be killed.
+ */
+int nrs_stop(Nrs *s) {
+    int status = -1;
+    if (s->sock >= 0)
+        close(s->sock);
+    s->sock = -1;
+    if (s->pid > 0) {
+        nrs_cmd(s, "9", 1);
+        for (int i = 0; i < 100; i++) {
+            if (waitpid(s->pid, &status, WNOHANG) == s->pid) {
+                s->pid = 0;
+                break;
+            }
+            usleep(20000);
+        }
+        if (s->pid > 0) {
+            kill(s->pid, SIGKILL);
+            waitpid(s->pid, NULL, 0);
+            s->pid = 0;
+            status = -1;
+        }
+    }
+    child = 0;
+    close(s->in);
+    close(s->out);
+    free(s->obuf);
+    s->obuf = NULL;
+    s->olen = s->osize = 0;
+    return !(status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/**
+ * @brief Removes the temporary directory.
+ */
+void nrs_cleanup(Nrs *s) {
+    char b[300];
+    if (strncmp(s->dir, "/tmp/nrstest_", 13) != 0)
+        return;
+    snprintf(b, 299, "rm -rf '%s'", s->dir);
+    if (system(b) != 0)
+        fprintf(stderr, "nrsdriver: could not remove %s\n", s->dir);
+}
+
+static unsigned int rnd(unsigned int *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 8) & 0xffffff;
+}
+
+/**
+ * @brief Builds the contents of a synthetic omnils_ file.
+ *
+ * The names are made of random syllables, so that they share prefixes as
+ * the names of real packages do. Most objects are functions whose usage and
+ * description have the quotes and '\x12' bytes found in real files.
+ *
+ * @param buf Where to store the malloc'd buffer.
+ * @param pkg Name of the package.
+ * @param n Number of lines.
+ * @param seed Seed of the random names.
+ * @return The size of the buffer.
+ */
+size_t fake_omnils(char **buf, const char *pkg, int n, unsigned int seed) {
+    static const char *syl[] = {"as", "read", "get", "set", "is", "to",
+                                "df", "plot", "map", "col", "row", "str",
+                                "lm", "fit", "data", "sum", "x", "table"};
+    size_t size = (size_t)n * 160 + 64;
+    char *b = malloc(size);
+    char nm[64];
+    size_t len = 0;
+    for (int i = 0; i < n; i++) {
+        int k = 1 + rnd(&seed) % 3;
+        nm[0] = 0;
+        for (int j = 0; j < k; j++) {
+            if (j)
+                strcat(nm, rnd(&seed) % 2 ? "_" : ".");
+            strcat(nm, syl[rnd(&seed) % 18]);
+        }
+        if (i % 10 == 0) {
+            len += sprintf(b + len,
+                           "%s_%d\006{\006numeric\006%s\006\006"
+                           "Data set\006A vector\006\n",
+                           nm, i, pkg);
+        } else {
+            len += sprintf(b + len,
+                           "%s_%d\006\003\006function\006%s\006"
+                           "[\022x\022, \022y = 'a'\022]\006Title o'f %s"
+                           "\006Returns \022x\022 or 'y'\006\n",
+                           nm, i, pkg, nm);
+        }
+    }
+    *buf = b;
+    return len;
+}
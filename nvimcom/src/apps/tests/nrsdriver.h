@@ -0,0 +1,38 @@
+#ifndef NRSDRIVER_H
+#define NRSDRIVER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// An rnvimserver started by a test or benchmark. The driver plays the roles
+// of both Neovim (stdin and stdout) and nvimcom (the socket).
+typedef struct nrs_ {
+    pid_t pid;       // Process ID of rnvimserver
+    int in;          // Its stdin
+    int out;         // Its stdout
+    int sock;        // Connection to it, as nvimcom, or -1
+    char *obuf;      // What was read from stdout and not consumed yet
+    size_t olen;     // Bytes in obuf
+    size_t osize;    // Size of obuf
+    char dir[256];   // Temporary directory with tmp/ and compl/
+    char rpath[300]; // RNVIM_RPATH, or empty for /bin/false
+} Nrs;
+
+double nrs_now(void);
+void nrs_mkdir(Nrs *s);
+void nrs_fake_r(Nrs *s);
+void nrs_start(Nrs *s, const char *compldir, int unix_socket);
+void nrs_connect(Nrs *s);
+void nrs_cmd(Nrs *s, const char *cmd, size_t len);
+void nrs_send(Nrs *s, const char *body, size_t len);
+char *nrs_readline(Nrs *s, int timeout_ms);
+char *nrs_wait_for(Nrs *s, const char *str, int timeout_ms);
+void nrs_drain(Nrs *s, int quiet_ms);
+int nrs_stop(Nrs *s);
+void nrs_cleanup(Nrs *s);
+
+void write_file(const char *fname, const char *s, size_t len);
+size_t fake_omnils(char **buf, const char *pkg, int n, unsigned int seed);
+int cmp_double(const void *a, const void *b);
+
+#endif // NRSDRIVER_H
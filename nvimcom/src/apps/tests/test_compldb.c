@@ -0,0 +1,262 @@
+#include "../compldb.c" // To check the files directly
+#include "../logging.c"
+#include "nrsdriver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/*
+ * Invalidation of compl_ files.
+ *
+ * rnvimserver writes the compl_ file of a package the first time it reads the
+ * omnils_ file, and maps it on the next start. The test checks that a compl_
+ * file is used when it is up to date, and replaced when the omnils_ file was
+ * touched or changed, or when the compl_ file has a corrupt header, was
+ * truncated or has offsets out of the string table. In every case, the
+ * completions must be those of the omnils_ file, and compldb_open() must
+ * reject the bad file.
+ */
+
+#define N_OBJS 2000
+#define N_BASES 40
+#define MARKER "tpkg_is_loaded"
+
+static char fomnils[512], fcompl[512];
+static int errors;
+
+static char *read_file(const char *fname, size_t *len) {
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    rewind(f);
+    char *b = malloc(*len + 1);
+    if (fread(b, 1, *len, f) != *len) {
+        free(b);
+        b = NULL;
+    }
+    fclose(f);
+    return b;
+}
+
+// Checks the compl_ file as load_pkg_data() does
+static int compl_ok(void) {
+    struct stat st;
+    size_t sz;
+    OmnilsRecs r;
+    if (stat(fomnils, &st) != 0)
+        return 0;
+    char *b = read_file(fcompl, &sz);
+    if (!b)
+        return 0;
+    int ok = compldb_open(b, sz, st.st_size, st.st_mtime, &r);
+    free(b);
+    return ok;
+}
+
+static ino_t compl_ino(void) {
+    struct stat st;
+    return stat(fcompl, &st) == 0 ? st.st_ino : 0;
+}
+
+// Writes a synthetic omnils_ file with the marker object
+static size_t write_omnils(char **b, unsigned int seed) {
+    size_t len = fake_omnils(b, "tpkg", N_OBJS, seed);
+    *b = realloc(*b, len + 128);
+    len += sprintf(*b + len, MARKER "\006{\006logical\006tpkg\006\006"
+                             "Marker\006TRUE\006\n");
+    write_file(fomnils, *b, len);
+    return len;
+}
+
+/*
+ * Starts rnvimserver, loads the package and completes the bases. Returns the
+ * replies, which do not depend on whether the compl_ file was used.
+ */
+static char *complete(Nrs *s, char **bases) {
+    char cmd[128];
+    const char msg[] = "+Ltpkg\0031.0\004\n";
+    size_t len = 0, size = 1 << 20;
+    char *out = malloc(size);
+
+    nrs_start(s, NULL, 0);
+    nrs_connect(s);
+    nrs_send(s, msg, sizeof(msg) - 1);
+    for (int i = 0; i < N_BASES; i++) {
+        int clen = snprintf(cmd, 127, "5 %d\003%s", i, bases[i]);
+        char *r = NULL;
+        // The marker is completed until the package is loaded
+        for (int k = 0; k < 500; k++) {
+            nrs_cmd(s, cmd, clen);
+            r = nrs_readline(s, 10000);
+            if (!r || strstr(r, "{word = ") || i > 0)
+                break;
+            usleep(10000);
+        }
+        if (!r) {
+            fprintf(stderr, "test_compldb: no reply to %s\n", cmd);
+            exit(1);
+        }
+        size_t n = strlen(r);
+        if (len + n + 2 > size) {
+            size = 2 * (len + n + 2);
+            out = realloc(out, size);
+        }
+        memcpy(out + len, r, n);
+        len += n;
+        out[len++] = '\n';
+    }
+    out[len] = 0;
+    if (nrs_stop(s)) {
+        fprintf(stderr, "test_compldb: rnvimserver did not quit normally\n");
+        errors++;
+    }
+    return out;
+}
+
+static void expect(int cond, const char *what, const char *msg) {
+    if (!cond) {
+        fprintf(stderr, "test_compldb: %s: %s\n", what, msg);
+        errors++;
+    }
+}
+
+/*
+ * Writes a bad copy of the good compl_ file, checks that compldb_open()
+ * rejects it, and that rnvimserver replaces it and completes as before.
+ */
+static void check_bad(Nrs *s, char **bases, const char *ref, const char *what,
+                      const char *b, size_t len) {
+    write_file(fcompl, b, len);
+    expect(!compl_ok(), what, "compldb_open() accepted the file");
+    char *out = complete(s, bases);
+    expect(strcmp(out, ref) == 0, what, "the completions changed");
+    expect(compl_ok(), what, "the compl_ file was not replaced");
+    free(out);
+}
+
+int main(void) {
+    char *bases[N_BASES];
+    char fnm[512];
+    char *b;
+    Nrs s;
+
+    nrs_mkdir(&s);
+    snprintf(fomnils, 511, "%s/compl/omnils_tpkg_1.0", s.dir);
+    snprintf(fcompl, 511, "%s/compl/compl_tpkg_1.0", s.dir);
+    snprintf(fnm, 511, "%s/compl/fun_tpkg_1.0", s.dir);
+    write_file(fnm, "", 0);
+    size_t len = write_omnils(&b, 3);
+
+    // Whole names and prefixes of 1 to 3 characters. The first base is an
+    // object added to every version of the file, to know when the package
+    // is loaded.
+    bases[0] = MARKER;
+    srand(1);
+    for (int i = 1; i < N_BASES; i++) {
+        char *p = b + (rand() % N_OBJS) * (len / N_OBJS);
+        while (p > b && p[-1] != '\n')
+            p--;
+        int n = strchr(p, '\006') - p;
+        bases[i] = strndup(p, i % 4 == 0 || n < 4 ? n : i % 4);
+    }
+
+    // Without compl_ file, then with the one written by the first run
+    char *ref = complete(&s, bases);
+    expect(strstr(ref, "{word = ") != NULL, "first run", "no completions");
+    expect(compl_ok(), "first run", "no valid compl_ file");
+    size_t good_sz = 0;
+    char *good = read_file(fcompl, &good_sz);
+    if (!good || good_sz < sizeof(ComplDbHeader)) {
+        fprintf(stderr, "test_compldb: no compl_ file\n");
+        return 1;
+    }
+    ino_t ino = compl_ino();
+    char *out = complete(&s, bases);
+    expect(strcmp(out, ref) == 0, "valid compl_", "the completions changed");
+    expect(compl_ino() == ino, "valid compl_", "the file was replaced");
+    free(out);
+
+    // Corrupt header: magic, checksum and fields covered by the checksum
+    char *w = malloc(good_sz);
+    memcpy(w, good, good_sz);
+    w[0] = 'X';
+    check_bad(&s, bases, ref, "bad magic", w, good_sz);
+    memcpy(w, good, good_sz);
+    w[offsetof(ComplDbHeader, sum)] ^= 1;
+    check_bad(&s, bases, ref, "bad checksum", w, good_sz);
+    memcpy(w, good, good_sz);
+    w[offsetof(ComplDbHeader, n)] ^= 1;
+    check_bad(&s, bases, ref, "bad number of records", w, good_sz);
+
+    // Truncated, within the header and within the records
+    check_bad(&s, bases, ref, "truncated header", good, 20);
+    check_bad(&s, bases, ref, "truncated records", good, good_sz / 2);
+    check_bad(&s, bases, ref, "missing final byte", good, good_sz - 1);
+
+    // Offsets out of the string table, with a valid header
+    ComplDbHeader h;
+    OmnilsRecs r;
+    memcpy(&h, good, sizeof(h));
+    struct {
+        const char *what;
+        int field; // -1 for the name
+        int k;
+        uint32_t value;
+    } offs[] = {
+        {"name beyond the fields", -1, 0, 0xfffffff0},
+        {"last field beyond the table", 6, N_OBJS / 2, h.text_size + 1},
+        {"last field at UINT32_MAX", 6, N_OBJS - 1, UINT32_MAX},
+        {"fields out of order", 3, 1, 0},
+    };
+    for (size_t i = 0; i < sizeof(offs) / sizeof(offs[0]); i++) {
+        memcpy(w, good, good_sz);
+        compldb_set_arrays(&r, w + sizeof(h), h.n);
+        if (offs[i].field < 0)
+            ((uint32_t *)r.name)[offs[i].k] = offs[i].value;
+        else
+            ((uint32_t *)r.fld)[7 * offs[i].k + offs[i].field] =
+                offs[i].value;
+        check_bad(&s, bases, ref, offs[i].what, w, good_sz);
+    }
+
+    // The omnils_ file touched: same contents and size, newer mtime
+    struct timeval tv[2];
+    gettimeofday(&tv[0], NULL);
+    tv[0].tv_sec += 10;
+    tv[1] = tv[0];
+    utimes(fomnils, tv);
+    ino = compl_ino();
+    expect(!compl_ok(), "touched omnils_", "compldb_open() accepted the file");
+    out = complete(&s, bases);
+    expect(strcmp(out, ref) == 0, "touched omnils_", "the completions changed");
+    expect(compl_ok() && compl_ino() != ino, "touched omnils_",
+           "the compl_ file was not replaced");
+    free(out);
+
+    // The omnils_ file rebuilt with other objects: the completions must be
+    // those of the new file, as when there is no compl_ file
+    free(b);
+    write_omnils(&b, 4);
+    out = complete(&s, bases);
+    expect(compl_ok(), "new omnils_", "the compl_ file was not replaced");
+    remove(fcompl);
+    char *nocompl = complete(&s, bases);
+    expect(strcmp(out, nocompl) == 0, "new omnils_",
+           "the completions differ from those without compl_ file");
+    expect(strcmp(out, ref) != 0, "new omnils_", "the completions are old");
+    free(out);
+    free(nocompl);
+    free(ref);
+    free(good);
+    free(w);
+    free(b);
+
+    nrs_cleanup(&s);
+    printf("test_compldb: %s\n", errors ? "FAILED" : "OK");
+    return errors != 0;
+}
@@ -0,0 +1,103 @@
+#include "nrsdriver.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/*
+ * Requests to expand lists in .GlobalEnv (X messages).
+ *
+ * With RNVIM_OPENLS set, every list shown in the Object Browser is open, so
+ * rnvimserver asks nvimcom to list the elements of all of them. The paths do
+ * not fit in a single message. The test checks that every message ends with
+ * a NULL byte, and that each path is requested exactly once, even when the
+ * same .GlobalEnv is sent again.
+ */
+
+#define N_LISTS 300
+
+static char *rbuf;
+static size_t rlen;
+
+// Reads from the socket until nothing arrives for quiet_ms
+static void read_socket(Nrs *s, int quiet_ms) {
+    static size_t rsize;
+    struct pollfd pfd = {s->sock, POLLIN, 0};
+    while (poll(&pfd, 1, quiet_ms) > 0) {
+        if (rsize - rlen < 4096) {
+            rsize = rsize ? 2 * rsize : 65536;
+            rbuf = realloc(rbuf, rsize);
+        }
+        ssize_t r = recv(s->sock, rbuf + rlen, rsize - rlen, 0);
+        if (r <= 0)
+            break;
+        rlen += r;
+    }
+}
+
+int main(void) {
+    char *b = malloc(N_LISTS * 128 + 8);
+    int seen[N_LISTS] = {0};
+    int errors = 0, nmsg = 0;
+    Nrs s;
+
+    size_t len = sprintf(b, "+G");
+    for (int i = 0; i < N_LISTS; i++)
+        len += sprintf(b + len,
+                       "a_list_with_a_rather_long_name_%03d\006[\006list"
+                       "\006.GlobalEnv\006\006\006 [2]\006\n",
+                       i);
+
+    setenv("RNVIM_OPENLS", "1", 1);
+    nrs_mkdir(&s);
+    nrs_start(&s, NULL, 1);
+    nrs_connect(&s);
+    nrs_cmd(&s, "31", 2);
+    nrs_send(&s, b, len);
+    read_socket(&s, 1000);
+    nrs_send(&s, b, len);
+    read_socket(&s, 1000);
+
+    if (rlen == 0 || rbuf[rlen - 1] != 0) {
+        fprintf(stderr, "test_expand: the last message is incomplete\n");
+        errors++;
+        rlen = 0;
+    }
+    for (char *m = rbuf; m < rbuf + rlen; m += strlen(m) + 1) {
+        nmsg++;
+        if (strncmp(m, "X77", 3) != 0 || m[strlen(m) - 1] != '\n') {
+            fprintf(stderr, "test_expand: bad message: %.80s\n", m);
+            errors++;
+            continue;
+        }
+        for (char *p = m + 3; *p; p = strchr(p, '\n') + 1) {
+            int i;
+            if (sscanf(p, "a_list_with_a_rather_long_name_%d\n", &i) != 1 ||
+                i < 0 || i >= N_LISTS) {
+                fprintf(stderr, "test_expand: bad path: %.80s\n", p);
+                errors++;
+                break;
+            }
+            seen[i]++;
+        }
+    }
+    for (int i = 0; i < N_LISTS; i++) {
+        if (seen[i] != 1) {
+            fprintf(stderr, "test_expand: path %d requested %d times\n", i,
+                    seen[i]);
+            errors++;
+        }
+    }
+    if (nrs_stop(&s)) {
+        fprintf(stderr, "test_expand: rnvimserver did not quit normally\n");
+        errors++;
+    }
+    nrs_cleanup(&s);
+    free(b);
+    free(rbuf);
+
+    printf("test_expand: %d paths in %d messages: %s\n", N_LISTS, nmsg,
+           errors ? "FAILED" : "OK");
+    return errors != 0;
+}
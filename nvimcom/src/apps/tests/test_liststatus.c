@@ -0,0 +1,108 @@
+#include "../data_structures.c" // To reach LS_BLOCK and LS_ARENA_BLOCK
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * ListStatusTable with enough keys to grow its slots many times and to fill
+ * many blocks of its pool and of its key arena.
+ *
+ * The entries returned by list_status_add() must stay where they are while
+ * the table grows, since rnvimserver keeps pointers to them, and
+ * list_status_at() must return them in the order of insertion, which
+ * change_all(), print_listTree() and obstatus_save() rely on.
+ */
+
+#define N_KEYS 100000
+
+static int errors;
+
+static void expect(int cond, const char *msg, unsigned int i) {
+    if (!cond && errors++ < 20)
+        fprintf(stderr, "test_liststatus: %s (entry %u)\n", msg, i);
+}
+
+// A path of the Object Browser: libraries, objects and list elements
+static void make_key(char *b, unsigned int i) {
+    if (i % 1000 == 0)
+        sprintf(b, "pkg%03u:", i / 1000);
+    else if (i % 100 == 0)
+        sprintf(b, ".GlobalEnv-obj_%u", i / 100);
+    else
+        sprintf(b, ".GlobalEnv-obj_%u$el%02u", i / 100, i % 100);
+}
+
+int main(void) {
+    static ListStatus *added[N_KEYS + 2];
+    static char copy[N_KEYS + 2][48];
+    char key[48];
+
+    // A long key goes into a block of its own, and the empty key is valid
+    size_t llen = LS_ARENA_BLOCK + 100;
+    char *longkey = malloc(llen + 1);
+    memset(longkey, 'x', llen);
+    longkey[llen] = 0;
+
+    ListStatusTable *t = new_ListStatusTable();
+    unsigned int size0 = t->size;
+    for (unsigned int i = 0; i < N_KEYS; i++) {
+        make_key(copy[i], i);
+        strcpy(key, copy[i]); // The key must be copied by the table
+        added[i] = list_status_add(t, key, i % 2);
+        memset(key, '?', sizeof(key) - 1);
+        // Changes made through the pointer must survive the growth
+        if (i % 3 == 0)
+            added[i]->user = 1;
+        if (i == N_KEYS / 2) {
+            added[N_KEYS] = list_status_add(t, longkey, 1);
+            added[N_KEYS + 1] = list_status_add(t, "", 1);
+        }
+    }
+    expect(t->n == N_KEYS + 2, "wrong number of entries", t->n);
+    expect(t->size > 8 * size0, "the slots did not grow", t->size);
+    expect(t->npool == (N_KEYS + 2 + LS_BLOCK - 1) / LS_BLOCK,
+           "wrong number of pool blocks", t->npool);
+    expect(4 * t->n <= 3 * t->size, "the table is too full", t->size);
+
+    // Lookups and insertion order
+    unsigned int k = 0;
+    for (unsigned int i = 0; i < t->n; i++) {
+        ListStatus *e = list_status_at(t, i);
+        if (i == N_KEYS / 2 + 1) {
+            expect(e == added[N_KEYS], "long key out of order", i);
+            expect(strcmp(e->key, longkey) == 0, "long key changed", i);
+            continue;
+        }
+        if (i == N_KEYS / 2 + 2) {
+            expect(e == added[N_KEYS + 1], "empty key out of order", i);
+            expect(list_status_get(t, "") == e, "empty key not found", i);
+            continue;
+        }
+        expect(e == added[k], "list_status_at() out of insertion order", i);
+        expect(strcmp(e->key, copy[k]) == 0, "key changed", i);
+        expect(list_status_get(t, copy[k]) == added[k], "entry moved", i);
+        expect(e->status == (int)(k % 2), "status changed", i);
+        expect(e->user == (k % 3 == 0), "user flag changed", i);
+        k++;
+    }
+    expect(list_status_get(t, longkey) == added[N_KEYS], "long key missing",
+           0);
+
+    // Keys that were not added, including prefixes of added ones
+    const char *missing[] = {"pkg000", "pkg100:", ".GlobalEnv-obj_1$el",
+                             ".GlobalEnv-obj_0", "base:", "x"};
+    for (size_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++)
+        expect(list_status_get(t, missing[i]) == NULL, missing[i], i);
+
+    // As change_all() does, in insertion order
+    for (unsigned int i = 0; i < t->n; i++)
+        list_status_at(t, i)->status = 2;
+    for (unsigned int i = 0; i < N_KEYS; i++)
+        expect(list_status_get(t, copy[i])->status == 2,
+               "change through list_status_at() not seen", i);
+
+    free(longkey);
+    printf("test_liststatus: %d entries in %u blocks, %u slots: %s\n", t->n,
+           t->npool, t->size, errors ? "FAILED" : "OK");
+    return errors != 0;
+}
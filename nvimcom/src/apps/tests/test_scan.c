@@ -0,0 +1,180 @@
+#include "../scan.c" // The kernels are static
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Compares the SSE2 and AVX2 kernels of scan.c with the scalar one, and the
+ * scalar one with a plain reference implementation, both converting and only
+ * checking the lines. The cases include invalid lines, tails shorter than a
+ * vector, and separators, newlines, quotes and '\x12' at the edges of the
+ * vectors.
+ */
+
+typedef long (*ScanFn)(char *, size_t, int, size_t *);
+
+static int errors;
+static long ncases;
+
+// Two passes, as check_omils_buffer() did before the kernels
+static long reference(char *b, size_t len, int convert, size_t *bad) {
+    int n = 0;
+    long nl = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (b[i] == '\006')
+            n++;
+        if (b[i] == '\n') {
+            if (n != 7) {
+                *bad = i + 1;
+                return -1;
+            }
+            n = 0;
+            nl++;
+        }
+    }
+    for (size_t i = 0; convert && i < len; i++) {
+        if (b[i] == '\006')
+            b[i] = 0;
+        else if (b[i] == '\'')
+            b[i] = '\x13';
+        else if (b[i] == '\x12')
+            b[i] = '\'';
+    }
+    return nl;
+}
+
+// Runs a kernel and the expected one on copies of a buffer and compares them
+static void compare(const char *what, ScanFn fn, ScanFn expected,
+                    const char *src, size_t len) {
+    for (int convert = 0; convert < 2; convert++) {
+        char *a = malloc(len + 1);
+        char *b = malloc(len + 1);
+        memcpy(a, src, len);
+        memcpy(b, src, len);
+        size_t abad = 0, bbad = 0;
+        long an = fn(a, len, convert, &abad);
+        long bn = expected(b, len, convert, &bbad);
+        ncases++;
+        // An invalid buffer is only partially converted
+        if (an != bn || (an < 0 && abad != bbad) ||
+            (an >= 0 && memcmp(a, b, len) != 0)) {
+            if (errors < 20)
+                fprintf(stderr,
+                        "test_scan: %s (convert = %d, len = %zu): %ld lines "
+                        "and bad = %zu, expected %ld and %zu\n",
+                        what, convert, len, an, abad, bn, bbad);
+            errors++;
+        }
+        free(a);
+        free(b);
+    }
+}
+
+// Fills b with valid lines of the given length (at least 8)
+static void valid_lines(char *b, size_t len, size_t line_len) {
+    for (size_t i = 0; i < len; i++) {
+        size_t j = i % line_len;
+        b[i] = j == line_len - 1 ? '\n' : j < 7 ? '\006' : 'a' + j % 26;
+    }
+}
+
+static void check_kernel(const char *name, ScanFn fn) {
+    char b[512], w[512];
+    char what[128];
+
+    // Tails shorter than a vector, alone and after whole vectors
+    for (size_t len = 0; len < 200; len++) {
+        for (size_t ll = 8; ll < 40; ll += 7) {
+            valid_lines(b, len, ll);
+            snprintf(what, 127, "%s, lines of %zu bytes", name, ll);
+            compare(what, fn, scan_scalar, b, len);
+        }
+    }
+
+    // Special bytes at every position around the edges of the vectors
+    const char special[] = {'\006', '\n', '\'', '\x12', '\x13', 0};
+    for (size_t pos = 0; pos < 130; pos++) {
+        for (size_t k = 0; k < sizeof(special); k++) {
+            for (size_t len = pos + 1; len < pos + 40 && len < 200;
+                 len += 3) {
+                valid_lines(b, len, 16);
+                b[pos] = special[k];
+                snprintf(what, 127, "%s, byte %d at %zu", name, special[k],
+                         pos);
+                compare(what, fn, scan_scalar, b, len);
+                // Quotes in a line that stays valid
+                valid_lines(b, len, 32);
+                if (b[pos] != '\n' && b[pos] != '\006') {
+                    b[pos] = special[k] == '\n' ? '\'' : special[k];
+                    compare(what, fn, scan_scalar, b, len);
+                }
+            }
+        }
+    }
+
+    // Lines with a missing or extra separator, crossing vector edges
+    for (size_t bad = 0; bad < 8; bad++) {
+        for (size_t ll = 9; ll < 70; ll++) {
+            valid_lines(b, 256, ll);
+            memcpy(w, b, 256);
+            size_t at = bad * ll + 3;
+            if (at + 1 >= 256)
+                continue;
+            w[at] = 'x'; // 6 separators
+            snprintf(what, 127, "%s, line %zu of %zu bytes with 6 separators",
+                     name, bad, ll);
+            compare(what, fn, scan_scalar, w, 256);
+            memcpy(w, b, 256);
+            w[bad * ll + 7] = '\006'; // 8 separators
+            snprintf(what, 127, "%s, line %zu of %zu bytes with 8 separators",
+                     name, bad, ll);
+            compare(what, fn, scan_scalar, w, 256);
+        }
+    }
+
+    // Random buffers, mostly made of special bytes
+    srand(1);
+    const char al[] = "ab\006\006\006\006\006\006\006\n\n'\x12\x13";
+    for (int t = 0; t < 20000; t++) {
+        size_t len = rand() % sizeof(b);
+        if (t % 2) {
+            valid_lines(b, len, 8 + rand() % 40);
+            for (int k = rand() % 4; k > 0 && len; k--)
+                b[rand() % len] = al[rand() % (sizeof(al) - 1)];
+        } else {
+            for (size_t i = 0; i < len; i++)
+                b[i] = al[rand() % (sizeof(al) - 1)];
+        }
+        snprintf(what, 127, "%s, random buffer %d", name, t);
+        compare(what, fn, scan_scalar, b, len);
+    }
+}
+
+int main(void) {
+    // The reference for the scalar kernel is the plain two-pass scan
+    char b[512];
+    srand(2);
+    for (int t = 0; t < 20000; t++) {
+        size_t len = rand() % sizeof(b);
+        valid_lines(b, len, 8 + rand() % 40);
+        for (int k = rand() % 3; k > 0 && len; k--)
+            b[rand() % len] = "\006\n'\x12x"[rand() % 5];
+        compare("scalar", scan_scalar, reference, b, len);
+    }
+
+    int nk = 1;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        check_kernel("sse2", scan_sse2);
+        nk++;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        check_kernel("avx2", scan_avx2);
+        nk++;
+    }
+#endif
+    printf("test_scan: %d kernels, %ld cases: %s\n", nk, ncases,
+           errors ? "FAILED" : "OK");
+    return errors != 0;
+}
@@ -0,0 +1,158 @@
+#include "nrsdriver.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Completion requests over stdin while multi-MB +G messages arrive over the
+ * socket.
+ *
+ * Since the event loop handles stdin and the socket on the same thread, each
+ * request must see either the .GlobalEnv before a +G or the one after it,
+ * never a mix or freed memory. Each +G has about 4 MB of objects and a
+ * marker, mark_<n>, where n is the number of the +G. The test checks that:
+ *
+ *   - every request gets exactly one reply, in order, with its own id;
+ *   - the size in the frame of the reply matches its length;
+ *   - "mark_" completes to exactly one marker, and n never decreases;
+ *   - the names of the loaded package are always completed;
+ *   - rnvimserver quits normally at the end.
+ */
+
+#define N_GLBENV 20
+#define N_OBJS 100000
+
+static Nrs s;
+static volatile int sent; // Number of +G already sent
+
+static void *send_glbenv(void *arg) {
+    (void)arg;
+    char *b = malloc((size_t)N_OBJS * 64 + 64);
+    for (int g = 1; g <= N_GLBENV; g++) {
+        size_t len = sprintf(b, "+Gmark_%d\006{\006\006.GlobalEnv\006\006\006"
+                                " [1]\006\n", g);
+        for (int i = 0; i < N_OBJS; i++)
+            len += sprintf(b + len,
+                           "gvar_%d_%d\006{\006numeric\006.GlobalEnv\006\006"
+                           "\006 [1]\006\n",
+                           g, i);
+        nrs_send(&s, b, len);
+        sent = g;
+    }
+    free(b);
+    return NULL;
+}
+
+static int fail(int id, const char *what, const char *reply) {
+    fprintf(stderr, "test_stress: request %d: %s\n  %.200s\n", id, what,
+            reply ? reply : "(no reply)");
+    return 1;
+}
+
+int main(void) {
+    char fnm[512], cmd[64], head[64];
+    char *omnils;
+    pthread_t tid;
+    double *lat = malloc(1000000 * sizeof(double));
+    int nreq = 0, last_mark = 0, errors = 0;
+
+    nrs_mkdir(&s);
+    size_t len = fake_omnils(&omnils, "stpkg", 50000, 1);
+    len += sprintf(omnils + len, "read_me_please\006\003\006function\006stpkg"
+                                 "\006[x]\006Title\006Description\006\n");
+    snprintf(fnm, 511, "%s/compl/omnils_stpkg_1.0", s.dir);
+    write_file(fnm, omnils, len);
+    snprintf(fnm, 511, "%s/compl/fun_stpkg_1.0", s.dir);
+    write_file(fnm, "", 0);
+    free(omnils);
+
+    nrs_start(&s, NULL, 0);
+    nrs_connect(&s);
+    const char *libs = "+Lstpkg\0031.0\004\n";
+    nrs_send(&s, libs, strlen(libs));
+    nrs_drain(&s, 300);
+
+    pthread_create(&tid, NULL, send_glbenv, NULL);
+    // Keep going until the last +G is seen, and then a little more
+    double end = nrs_now() + 120000;
+    int after = 0;
+    while (after < 30 && nrs_now() < end) {
+        if (last_mark == N_GLBENV)
+            after++;
+        int id = ++nreq;
+        int kind = id % 3;
+        int clen = snprintf(cmd, 63, "5 %d\003%s", id,
+                            kind == 0   ? "mark_"
+                            : kind == 1 ? "read_me_p"
+                                        : "\007stpkg::rdmplease");
+        double t = nrs_now();
+        nrs_cmd(&s, cmd, clen);
+        char *r = nrs_readline(&s, 20000);
+        lat[id - 1] = nrs_now() - t;
+        if (!r) {
+            errors += fail(id, "timeout", NULL);
+            break;
+        }
+
+        // Frame and id
+        long fsz = 0;
+        if (r[0] != '\x11' || sscanf(r + 1, "%ld", &fsz) != 1) {
+            errors += fail(id, "not framed", r);
+            continue;
+        }
+        char *body = strchr(r + 1, '\x11');
+        if (!body || fsz != (long)strlen(body + 1)) {
+            errors += fail(id, "wrong frame size", r);
+            continue;
+        }
+        snprintf(head, 63, "lua cb( %d, {", id);
+        if (strncmp(body + 1, head, strlen(head)) != 0) {
+            errors += fail(id, "wrong id", r);
+            continue;
+        }
+
+        // Contents
+        if (kind == 0) {
+            char *m = strstr(r, "word = 'mark_");
+            if (!m) {
+                // No +G was processed yet
+                if (last_mark)
+                    errors += fail(id, "marker lost", r);
+                continue;
+            }
+            int mk = atoi(m + 13);
+            if (strstr(m + 13, "word = 'mark_"))
+                errors += fail(id, "two markers", r);
+            else if (mk < last_mark || mk > N_GLBENV)
+                errors += fail(id, "wrong marker", r);
+            last_mark = mk;
+        } else if (!strstr(r, "read_me_please', menu")) {
+            errors += fail(id, "package name missing", r);
+        }
+        if (errors > 10)
+            break;
+    }
+    pthread_join(tid, NULL);
+
+    if (last_mark != N_GLBENV)
+        errors += fail(nreq, "the last +G was not seen", NULL);
+    if (nrs_stop(&s)) {
+        fprintf(stderr, "test_stress: rnvimserver did not quit normally\n");
+        errors++;
+    }
+    nrs_cleanup(&s);
+
+    qsort(lat, nreq, sizeof(double), cmp_double);
+    printf("test_stress: %d requests during %d +G of %d objects; "
+           "p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           nreq, N_GLBENV, N_OBJS, lat[nreq / 2], lat[nreq * 99 / 100],
+           lat[nreq - 1]);
+    free(lat);
+    if (errors) {
+        printf("test_stress: FAILED\n");
+        return 1;
+    }
+    printf("test_stress: OK\n");
+    return 0;
+}
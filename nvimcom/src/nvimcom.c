@@ -24,10 +24,12 @@
 #else
 #include <arpa/inet.h> // inet_addr()
 #include <netdb.h>
+#include <netinet/tcp.h> // TCP_NODELAY
 #include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #endif
 
 static int initialized = 0; // TCP client successfully connected to the server.
@@ -39,6 +41,9 @@ static int allnames = 0; // Show hidden objects in omni completion and
 static int nlibs = 0;    // Number of loaded libraries.
 
 static char nrs_port[16]; // rnvimserver port.
+#ifndef WIN32
+static char nrs_sock[108]; // Path to rnvimserver's Unix domain socket.
+#endif
 static char nvimsecr[32]; // Random string used to increase the safety of TCP
                           // communication.
 
@@ -52,20 +57,69 @@ static char *send_ge_buf; // Temporary buffer used to store the list of
 static unsigned long lastglbnvbsz;         // Previous size of glbnvbuf2.
 static unsigned long glbnvbufsize = 32768; // Current size of glbnvbuf2.
 
+/**
+ * @typedef glb_block_
+ * @brief Position of the lines describing a .GlobalEnv object in glbnvbuf1 or
+ * glbnvbuf2. The block includes the lines of the elements of lists and S4
+ * objects.
+ */
+typedef struct glb_block_ {
+    unsigned long start;    // Offset of the first line in the buffer.
+    unsigned long len;      // Number of bytes in the block.
+    unsigned long long sig; // Signature of the object when it was described.
+} GlbBlock;
+
+static GlbBlock *glbblk1;   // Blocks in glbnvbuf1.
+static GlbBlock *glbblk2;   // Blocks in glbnvbuf2.
+static int nglbblk1;        // Number of blocks in glbnvbuf1.
+static int nglbblk2;        // Number of blocks in glbnvbuf2.
+static int glbblksize;      // Allocated size of glbblk1 and glbblk2.
+static unsigned long glbseq; // Sequence number of the last +D message.
+static int glbresync = 1; // Should the whole list be sent in the next update?
+                          // It must be sent after the connection and when
+                          // rnvimserver lost track of the sequence numbers.
+
 static unsigned long tcp_header_len; // Length of nvimsecr + 9. Stored in a
                                      // variable to avoid repeatedly calling
                                      // strlen().
 
-static int maxdepth = 6; // How many levels to parse in lists and S4 objects
-// when building list of objects for omni-completion. The value decreases if
-// the listing is too slow and increases if there are more levels to be parsed
-// and the listing is fast enough.
-static int curdepth = 0; // Current level of the list or S4 object being parsed
-                         // for omni-completion.
+#define GLB_MAX_DEPTH 64 // Maximum number of nested lists and S4 objects.
+
+/**
+ * @typedef glb_frame_
+ * @brief A list or S4 object whose elements are being described. The
+ * description of .GlobalEnv is built by an iterator with an explicit stack of
+ * frames, so that it can be interrupted and resumed.
+ */
+typedef struct glb_frame_ {
+    SEXP x;        // The list or S4 object (preserved).
+    SEXP names;    // Names of the elements or of the slots (preserved).
+    int n;         // Number of elements.
+    int i;         // Next element to be described.
+    int s4;        // Is x an S4 object?
+    char env[576]; // Prefix of the elements' names (e.g. "alist$aS4obj@").
+} GlbFrame;
+
+static GlbFrame glbstack[GLB_MAX_DEPTH]; // Stack of the iterator.
+static int glbtop = 0;          // Number of frames in glbstack.
+static int glblisting = 0;      // Is the listing of .GlobalEnv in progress?
+static SEXP glbnames;           // Names of objects in .GlobalEnv (preserved).
+static int glbnnames;           // Length of glbnames.
+static int glbidx;              // Next object in glbnames.
+static unsigned long glboff;    // Where the next line will be written.
+static int glbj;                // Where to start searching for old blocks.
+static int glbnreused;          // Number of objects whose lines were reused.
+static int glbnslices;          // Number of slices in the current listing.
+static double glbtime;          // Time spent in the current listing (ms).
+static int slicetime = 20; // Maximum time (ms) spent in each slice of work
+                           // while listing .GlobalEnv (0 = no limit).
+static char **glbexp;      // Paths of lists and S4 objects whose elements must
+                           // be listed (requested by rnvimserver).
+static int nglbexp;        // Number of paths in glbexp.
 static int autoglbenv = 0; // Should the list of objects in .GlobalEnv be
 // automatically updated after each top level command is executed? It will
 // always be 1 if cmp-r is installed or the Object Browser is open.
-static clock_t tm; // Time when the listing of objects from .GlobalEnv started.
+static clock_t tm; // Time when the current slice of the listing started.
 
 static char tmpdir[512]; // The environment variable RNVIM_TMPDIR.
 static int setwidth = 0; // Set the option width after each command is executed
@@ -81,6 +135,9 @@ static int ifd;       // input file descriptor
 static int ofd;       // output file descriptor
 static InputHandler *ih;
 static char flag_eval[512]; // Do we have an R expression to evaluate?
+static char *flag_expand;     // Paths to be expanded, separated by '\n'.
+static size_t flag_expand_sz; // Size of flag_expand
+static pthread_mutex_t expand_lock = PTHREAD_MUTEX_INITIALIZER;
 static int flag_glbenv = 0; // Do we have to list objects from .GlobalEnv?
 #endif
 
@@ -390,6 +447,31 @@ static LibInfo *nvimcom_get_lib(const char *nm) {
     return NULL;
 }
 
+/**
+ * @brief Check if the elements of an object must be listed.
+ *
+ * Only the top level objects of .GlobalEnv are listed by default. The elements
+ * of a list or S4 object are listed if rnvimserver has requested the expansion
+ * of either the object or one of its descendants.
+ *
+ * @param curenv The "environment" of the object (see nvimcom_glbnv_line()).
+ * @param xname The name of the object.
+ * @return 1 if the object was expanded and 0 otherwise.
+ */
+static int nvimcom_is_expanded(const char *curenv, const char *xname) {
+    char path[576];
+    snprintf(path, 575, "%s%s", curenv, xname);
+    size_t plen = strlen(path);
+    for (int i = 0; i < nglbexp; i++) {
+        const char *e = glbexp[i];
+        if (strncmp(e, path, plen) == 0 &&
+            (e[plen] == 0 || e[plen] == '$' || e[plen] == '@' ||
+             e[plen] == '['))
+            return 1;
+    }
+    return 0;
+}
+
 /**
  * @brief This function adds a line with information for
  * omni-completion.
@@ -405,26 +487,25 @@ static LibInfo *nvimcom_get_lib(const char *nm) {
  * @param p A pointer to the current NULL byte terminating the glbnvbuf2
  * buffer.
  *
- * @param depth Current number of levels in lists and S4 objects.
+ * @param f Frame to be filled if x is a list or S4 object with elements to be
+ * described. Its field `n` is set to 0 otherwise. It might be NULL.
  *
  * @return The pointer p updated after the insertion of the new line.
  */
 static char *nvimcom_glbnv_line(SEXP *x, const char *xname, const char *curenv,
-                                char *p, int depth) {
-    if (depth > maxdepth)
-        return p;
-
-    if (depth > curdepth)
-        curdepth = depth;
-
+                                char *p, GlbFrame *f) {
     int xgroup = 0; // 1 = function, 2 = data.frame, 3 = list, 4 = s4
     char ebuf[64];
     int len = 0;
     SEXP txt, lablab;
     SEXP sn = R_NilValue;
+    int nsn = 0; // Whether sn is protected
     char buf[576];
     char bbuf[512];
 
+    if (f)
+        f->n = 0;
+
     if ((strlen(glbnvbuf2 + lastglbnvbsz)) > 31744)
         p = nvimcom_grow_buffers();
 
@@ -505,10 +586,10 @@ static char *nvimcom_glbnv_line(SEXP *x, const char *xname, const char *curenv,
 
     // Add the object length
     if (xgroup == 2) {
-        snprintf(buf, 127, " [%d, %d]", length(Rf_GetRowNames(*x)), length(*x));
+        snprintf(buf, 127, " [%d, %d]", length(Rf_GetRowNames(*x)), length(*x));
         p = nvimcom_strcat(p, buf);
     } else if (xgroup == 3) {
-        snprintf(buf, 127, " [%d]", length(*x));
+        snprintf(buf, 127, " [%d]", length(*x));
         p = nvimcom_strcat(p, buf);
     } else if (xgroup == 4) {
         SEXP cmdSexp, cmdexpr;
@@ -521,170 +602,363 @@ static char *nvimcom_glbnv_line(SEXP *x, const char *xname, const char *curenv,
         PROTECT(cmdexpr = R_ParseVector(cmdSexp, -1, &status, R_NilValue));
         if (status == PARSE_OK) {
             int er = 0;
-            PROTECT(sn = R_tryEval(VECTOR_ELT(cmdexpr, 0), R_GlobalEnv, &er));
-            if (er)
+            sn = R_tryEval(VECTOR_ELT(cmdexpr, 0), R_GlobalEnv, &er);
+            if (er) {
                 REprintf("nvimcom error executing command: slotNames(%s%s)\n",
                          curenv, xname);
-            else
+                sn = R_NilValue;
+            } else {
                 len = length(sn);
-            UNPROTECT(1);
+            }
         } else {
             REprintf("nvimcom error: invalid value in slotNames(%s%s)\n",
                      curenv, xname);
         }
         UNPROTECT(2);
-        snprintf(buf, 127, " [%d]", len);
+        // Only f will reference sn: it is protected again by
+        // nvimcom_glbnv_push() before being preserved
+        PROTECT(sn);
+        nsn = 1;
+        snprintf(buf, 127, " [%d]", len);
         p = nvimcom_strcat(p, buf);
     }
 
     // finish the line
     p = nvimcom_strcat(p, "\006\n");
 
-    if (xgroup > 1) {
-        char newenv[576];
-        SEXP elmt = R_NilValue;
-        const char *ename;
-        double tmdiff = 1000 * ((double)clock() - tm) / CLOCKS_PER_SEC;
-        if (tmdiff > 300.0) {
-            maxdepth = curdepth;
-            if (verbose > 3)
-                REprintf("nvimcom: slow at building list of objects (%g ms); "
-                         "maxdepth = %d\n",
-                         tmdiff, maxdepth);
-            return p;
-        } else if (tmdiff < 100.0 && maxdepth <= curdepth) {
-            maxdepth++;
-            if (verbose > 3)
-                REprintf("nvimcom: increased maxdepth to %d (time to build "
-                         "completion data = %g)\n",
-                         maxdepth, tmdiff);
-        }
+    if (f == NULL || xgroup < 2 || !nvimcom_is_expanded(curenv, xname)) {
+        UNPROTECT(nsn);
+        return p;
+    }
 
-        if (xgroup == 4) {
-            snprintf(newenv, 575, "%s%s@", curenv, xname);
-            if (len > 0) {
-                for (int i = 0; i < len; i++) {
-                    ename = CHAR(STRING_ELT(sn, i));
-                    PROTECT(elmt = R_do_slot(*x, Rf_install(ename)));
-                    p = nvimcom_glbnv_line(&elmt, ename, newenv, p, depth + 1);
-                    UNPROTECT(1);
-                }
-            }
+    // Let the iterator describe the elements
+    f->x = *x;
+    if (xgroup == 4) {
+        f->s4 = 1;
+        f->names = sn;
+        f->n = len;
+        snprintf(f->env, 575, "%s%s@", curenv, xname);
+    } else {
+        f->s4 = 0;
+        f->names = getAttrib(*x, R_NamesSymbol);
+        f->n = length(*x);
+        if (length(f->names) == 0) {
+            f->names = R_NilValue;
+            snprintf(f->env, 575, "%s%s", curenv, xname);
         } else {
-            SEXP listNames;
-            snprintf(newenv, 575, "%s%s$", curenv, xname);
-            PROTECT(listNames = getAttrib(*x, R_NamesSymbol));
-            len = length(listNames);
-            if (len == 0) { /* Empty list? */
-                int len1 = length(*x);
-                if (len1 > 0) { /* List without names */
-                    len1 -= 1;
-                    if (newenv[strlen(newenv) - 1] == '$')
-                        newenv[strlen(newenv) - 1] = 0; // Delete trailing '$'
-                    for (int i = 0; i < len1; i++) {
-                        sprintf(ebuf, "[[%d]]", i + 1);
-                        elmt = VECTOR_ELT(*x, i);
-                        p = nvimcom_glbnv_line(&elmt, ebuf, newenv, p,
-                                               depth + 1);
-                    }
-                    sprintf(ebuf, "[[%d]]", len1 + 1);
-                    PROTECT(elmt = VECTOR_ELT(*x, len));
-                    p = nvimcom_glbnv_line(&elmt, ebuf, newenv, p, depth + 1);
-                    UNPROTECT(1);
-                }
-            } else { /* Named list */
-                SEXP eexp;
-                len -= 1;
-                for (int i = 0; i < len; i++) {
-                    PROTECT(eexp = STRING_ELT(listNames, i));
-                    ename = CHAR(eexp);
-                    UNPROTECT(1);
-                    if (ename[0] == 0) {
-                        sprintf(ebuf, "[[%d]]", i + 1);
-                        ename = ebuf;
-                    }
-                    PROTECT(elmt = VECTOR_ELT(*x, i));
-                    p = nvimcom_glbnv_line(&elmt, ename, newenv, p, depth + 1);
-                    UNPROTECT(1);
-                }
-                ename = CHAR(STRING_ELT(listNames, len));
-                if (ename[0] == 0) {
-                    sprintf(ebuf, "[[%d]]", len + 1);
-                    ename = ebuf;
-                }
-                PROTECT(elmt = VECTOR_ELT(*x, len));
-                p = nvimcom_glbnv_line(&elmt, ename, newenv, p, depth + 1);
-                UNPROTECT(1);
-            }
-            UNPROTECT(1); /* listNames */
+            snprintf(f->env, 575, "%s%s$", curenv, xname);
         }
     }
+    f->i = 0;
+    UNPROTECT(nsn);
     return p;
 }
 
+/**
+ * @brief Find the block of an object in glbnvbuf1.
+ *
+ * Both glbnvbuf1 and glbnvbuf2 are built from the sorted output of
+ * `R_lsInternal()`, so the search starts from the block following the
+ * previous match.
+ *
+ * @param nm Name of the object (not necessarily NULL terminated).
+ * @param nlen Length of the name.
+ * @param from Index of the first block to be checked.
+ * @return The index of the block in glbblk1 or -1 if not found.
+ */
+static int nvimcom_find_old_block(const char *nm, size_t nlen, int from) {
+    for (int k = from; k < nglbblk1; k++) {
+        const char *o = glbnvbuf1 + glbblk1[k].start;
+        if (o[nlen] == '\006' && strncmp(o, nm, nlen) == 0)
+            return k;
+    }
+    return -1;
+}
+
+/**
+ * @brief Build in send_ge_buf a +D message with the differences between
+ * glbnvbuf1 and glbnvbuf2.
+ *
+ * Message format:
+ *   +D<seq>\003 : Header with the sequence number.
+ *   \001name\n  : The object `name` did not change since the last update.
+ *   \002lines   : New or changed object, including its list elements.
+ *
+ * Objects not present in the message were removed.
+ *
+ * @return 1 if the message is smaller than the complete list, and 0 otherwise.
+ */
+static int nvimcom_glbnv_delta(void) {
+    unsigned long max = strlen(glbnvbuf2);
+    char *p = send_ge_buf;
+    int j = 0;
+
+    p += sprintf(p, "+D%lu\003", glbseq + 1);
+    for (int i = 0; i < nglbblk2; i++) {
+        const char *nb = glbnvbuf2 + glbblk2[i].start;
+        int k = nvimcom_find_old_block(nb, strchr(nb, '\006') - nb, j);
+        if (k >= 0 && glbblk1[k].len == glbblk2[i].len &&
+            memcmp(glbnvbuf1 + glbblk1[k].start, nb, glbblk2[i].len) == 0) {
+            size_t nlen = strchr(nb, '\006') - nb;
+            if ((p - send_ge_buf) + nlen + 2 > max)
+                return 0;
+            *p = '\001';
+            p++;
+            memcpy(p, nb, nlen);
+            p += nlen;
+            *p = '\n';
+            p++;
+        } else {
+            if ((p - send_ge_buf) + glbblk2[i].len + 1 > max)
+                return 0;
+            *p = '\002';
+            p++;
+            memcpy(p, nb, glbblk2[i].len);
+            p += glbblk2[i].len;
+        }
+        if (k >= 0)
+            j = k + 1;
+    }
+    *p = 0;
+    return 1;
+}
+
 /**
  * @brief Send to R.nvim the string containing the list of objects in
- * .GlobalEnv.
+ * .GlobalEnv. Only the objects that changed since the previous update are sent
+ * unless rnvimserver has to receive the complete list.
  */
 static void send_glb_env(void) {
     clock_t t1;
 
     t1 = clock();
 
-    strcpy(send_ge_buf, "+G");
-    strcat(send_ge_buf, glbnvbuf2);
+    if (!glbresync && nvimcom_glbnv_delta()) {
+        glbseq++;
+    } else {
+        strcpy(send_ge_buf, "+G");
+        strcat(send_ge_buf, glbnvbuf2);
+        glbseq = 0;
+        glbresync = 0;
+    }
     send_to_nvim(send_ge_buf);
 
     if (verbose > 3)
-        REprintf("Time to send message to R.nvim: %f\n",
+        REprintf("Time to send message to R.nvim [%c, %zu bytes]: %f\n",
+                 send_ge_buf[1], strlen(send_ge_buf),
                  1000 * ((double)clock() - t1) / CLOCKS_PER_SEC);
 
     char *tmp = glbnvbuf1;
     glbnvbuf1 = glbnvbuf2;
     glbnvbuf2 = tmp;
+
+    GlbBlock *btmp = glbblk1;
+    glbblk1 = glbblk2;
+    glbblk2 = btmp;
+    nglbblk1 = nglbblk2;
 }
 
 /**
- * @brief Generate a list of objects in .GlobalEnv and store it in the
- * glbnvbuf2 buffer. The string stored in glbnvbuf2 represents a file with the
- * same format of the `omnils_` files in R.nvim's cache directory.
+ * @brief Mix a value into a signature.
  */
-static void nvimcom_globalenv_list(void) {
-    if (verbose > 4)
-        REprintf("nvimcom_globalenv_list()\n");
-    const char *varName;
-    SEXP envVarsSEXP, varSEXP;
+static unsigned long long nvimcom_sig_mix(unsigned long long h,
+                                          unsigned long long v) {
+    return (h ^ v) * 0x100000001b3ULL;
+}
 
-    if (tmpdir[0] == 0)
-        return;
+/**
+ * @brief Compute a cheap signature of an object.
+ *
+ * The signature changes when the object is replaced or when its type, length
+ * or attributes change. Lists and attribute values (which include the slots
+ * of S4 objects) are visited up to `maxd` levels, but nothing is evaluated or
+ * formatted. Objects with the same signature as in the previous listing do
+ * not have to be described again.
+ *
+ * @param x The object.
+ * @param depth Current number of levels in lists and S4 objects.
+ * @param maxd Maximum number of levels to be visited.
+ * @return The signature.
+ */
+static unsigned long long nvimcom_sig(SEXP x, int depth, int maxd) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    h = nvimcom_sig_mix(h, (unsigned long long)(size_t)x);
+    h = nvimcom_sig_mix(h, (unsigned long long)TYPEOF(x));
+    if (Rf_isVector(x))
+        h = nvimcom_sig_mix(h, (unsigned long long)XLENGTH(x));
+    if (Rf_isFrame(x))
+        h = nvimcom_sig_mix(h, (unsigned long long)length(Rf_GetRowNames(x)));
+    for (SEXP a = ATTRIB(x); a != R_NilValue; a = CDR(a)) {
+        h = nvimcom_sig_mix(h, (unsigned long long)(size_t)TAG(a));
+        if (depth < maxd)
+            h = nvimcom_sig_mix(h, nvimcom_sig(CAR(a), depth + 1, maxd));
+        else
+            h = nvimcom_sig_mix(h, (unsigned long long)(size_t)CAR(a));
+    }
+    if (TYPEOF(x) == VECSXP && depth < maxd) {
+        R_xlen_t n = XLENGTH(x);
+        for (R_xlen_t i = 0; i < n; i++)
+            h = nvimcom_sig_mix(h,
+                                nvimcom_sig(VECTOR_ELT(x, i), depth + 1, maxd));
+    }
+    return h;
+}
 
-    tm = clock();
+/**
+ * @brief Copy the description of an object from glbnvbuf1 to glbnvbuf2.
+ *
+ * @param k Index of the block in glbblk1.
+ * @param p A pointer to the current NULL byte terminating glbnvbuf2.
+ * @return The pointer p updated after the insertion of the block.
+ */
+static char *nvimcom_reuse_block(int k, char *p) {
+    while ((p - glbnvbuf2) + glbblk1[k].len + 1024 > glbnvbufsize)
+        p = nvimcom_grow_buffers();
+    memcpy(p, glbnvbuf1 + glbblk1[k].start, glbblk1[k].len);
+    p += glbblk1[k].len;
+    *p = 0;
+    return p;
+}
 
-    memset(glbnvbuf2, 0, glbnvbufsize);
-    char *p = glbnvbuf2;
+/**
+ * @brief Push a frame onto the stack of the .GlobalEnv iterator, protecting
+ * its objects until they are popped.
+ *
+ * The names of S4 objects are the value of slotNames(), which is referenced
+ * only by the frame. They are protected before R_PreserveObject() allocates
+ * memory.
+ */
+static void nvimcom_glbnv_push(void) {
+    GlbFrame *f = glbstack + glbtop;
+    PROTECT(f->names);
+    R_PreserveObject(f->x);
+    R_PreserveObject(f->names);
+    UNPROTECT(1);
+    glbtop++;
+}
+
+/**
+ * @brief Pop a frame from the stack of the .GlobalEnv iterator.
+ */
+static void nvimcom_glbnv_pop(void) {
+    glbtop--;
+    R_ReleaseObject(glbstack[glbtop].names);
+    R_ReleaseObject(glbstack[glbtop].x);
+}
+
+/**
+ * @brief Abandon the listing of .GlobalEnv in progress, if any.
+ */
+static void nvimcom_glbnv_reset(void) {
+    while (glbtop > 0)
+        nvimcom_glbnv_pop();
+    if (glblisting)
+        R_ReleaseObject(glbnames);
+    glblisting = 0;
+}
 
-    curdepth = 0;
+/**
+ * @brief Describe the next element of the list or S4 object on the top of the
+ * stack, pushing a new frame if the element has elements too. The frame is
+ * popped when all its elements were described.
+ *
+ * @param p A pointer to the current NULL byte terminating glbnvbuf2.
+ * @return The pointer p updated after the insertion of the new line.
+ */
+static char *nvimcom_glbnv_next_elmt(char *p) {
+    GlbFrame *f = glbstack + glbtop - 1;
+    if (f->i == f->n) {
+        nvimcom_glbnv_pop();
+        return p;
+    }
 
-    PROTECT(envVarsSEXP = R_lsInternal(R_GlobalEnv, allnames));
-    for (int i = 0; i < Rf_length(envVarsSEXP); i++) {
-        varName = CHAR(STRING_ELT(envVarsSEXP, i));
-        if (R_BindingIsActive(Rf_install(varName), R_GlobalEnv)) {
-            // See: https://github.com/jalvesaq/Nvim-R/issues/686
-            PROTECT(varSEXP = R_ActiveBindingFunction(Rf_install(varName),
-                                                      R_GlobalEnv));
+    SEXP elmt;
+    const char *ename;
+    char ebuf[64];
+    int i = f->i++;
+    GlbFrame *nf = glbtop < GLB_MAX_DEPTH ? glbstack + glbtop : NULL;
+    if (f->s4) {
+        ename = CHAR(STRING_ELT(f->names, i));
+        PROTECT(elmt = R_do_slot(f->x, Rf_install(ename)));
+    } else {
+        if (f->names == R_NilValue) {
+            ename = "";
         } else {
-            PROTECT(varSEXP = Rf_findVar(Rf_install(varName), R_GlobalEnv));
+            ename = CHAR(STRING_ELT(f->names, i));
         }
-        if (varSEXP != R_UnboundValue) {
-            // should never be unbound
-            p = nvimcom_glbnv_line(&varSEXP, varName, "", p, 0);
-        } else {
-            REprintf("nvimcom_globalenv_list: Unexpected R_UnboundValue.\n");
+        if (ename[0] == 0) {
+            sprintf(ebuf, "[[%d]]", i + 1);
+            ename = ebuf;
         }
+        PROTECT(elmt = VECTOR_ELT(f->x, i));
+    }
+    p = nvimcom_glbnv_line(&elmt, ename, f->env, p, nf);
+    if (nf && nf->n > 0)
+        nvimcom_glbnv_push();
+    UNPROTECT(1);
+    return p;
+}
+
+/**
+ * @brief Describe the next object from .GlobalEnv, or only its first line if
+ * it has elements to be described by nvimcom_glbnv_next_elmt(). If its
+ * signature did not change since the previous listing, the old lines are
+ * reused.
+ *
+ * @param p A pointer to the current NULL byte terminating glbnvbuf2.
+ * @return The pointer p updated after the insertion of the new lines.
+ */
+static char *nvimcom_glbnv_next_obj(char *p) {
+    SEXP varSEXP;
+    const char *varName = CHAR(STRING_ELT(glbnames, glbidx));
+    glbidx++;
+
+    if (R_BindingIsActive(Rf_install(varName), R_GlobalEnv)) {
+        // See: https://github.com/jalvesaq/Nvim-R/issues/686
+        PROTECT(varSEXP =
+                    R_ActiveBindingFunction(Rf_install(varName), R_GlobalEnv));
+    } else {
+        PROTECT(varSEXP = Rf_findVar(Rf_install(varName), R_GlobalEnv));
+    }
+    if (varSEXP == R_UnboundValue) {
+        // The object might have been removed by an input handler during a
+        // pause in the listing.
         UNPROTECT(1);
+        return p;
+    }
+
+    if (nglbblk2 == glbblksize) {
+        glbblksize += 256;
+        glbblk1 = realloc(glbblk1, glbblksize * sizeof(GlbBlock));
+        glbblk2 = realloc(glbblk2, glbblksize * sizeof(GlbBlock));
+    }
+    GlbBlock *b = glbblk2 + nglbblk2;
+    nglbblk2++;
+    b->start = p - glbnvbuf2;
+    b->len = 0;
+    // The elements of objects not expanded are not listed
+    b->sig = nvimcom_sig(varSEXP, 0,
+                         nvimcom_is_expanded("", varName) ? GLB_MAX_DEPTH : 0);
+    int k = nvimcom_find_old_block(varName, strlen(varName), glbj);
+    if (k >= 0)
+        glbj = k + 1;
+    if (k >= 0 && glbblk1[k].sig == b->sig) {
+        p = nvimcom_reuse_block(k, p);
+        glbnreused++;
+    } else {
+        p = nvimcom_glbnv_line(&varSEXP, varName, "", p, glbstack);
+        if (glbstack[0].n > 0)
+            nvimcom_glbnv_push();
     }
     UNPROTECT(1);
+    return p;
+}
 
+/**
+ * @brief Compare the new list of objects with the previous one and send it to
+ * rnvimserver if it has changed.
+ */
+static void nvimcom_glbnv_finish(void) {
     size_t len1 = strlen(glbnvbuf1);
     size_t len2 = strlen(glbnvbuf2);
     int changed = len1 != len2;
@@ -699,13 +973,121 @@ static void nvimcom_globalenv_list(void) {
         }
     }
 
-    if (changed)
+    if (changed || glbresync) {
         send_glb_env();
+    } else {
+        // The buffers are equal, but the signatures in glbblk2 are newer.
+        GlbBlock *btmp = glbblk1;
+        glbblk1 = glbblk2;
+        glbblk2 = btmp;
+        nglbblk1 = nglbblk2;
+    }
 
-    double tmdiff = 1000 * ((double)clock() - tm) / CLOCKS_PER_SEC;
-    if (verbose && tmdiff > 500.0)
+    if (verbose && glbtime > 500.0)
         REprintf("Time to build GlobalEnv omnils [%lu bytes]: %f ms\n",
-                 strlen(glbnvbuf2), tmdiff);
+                 strlen(glbnvbuf1), glbtime);
+    if (verbose > 3)
+        REprintf("GlobalEnv omnils: %d of %d objects reused; %d slice(s); "
+                 "%f ms\n",
+                 glbnreused, nglbblk1, glbnslices, glbtime);
+}
+
+/**
+ * @brief Do a slice of the work of listing the objects from .GlobalEnv.
+ *
+ * The work is interrupted after `slicetime` milliseconds. It is resumed by
+ * nvimcom_exec() the next time that R is idle (on Unix) or by the next call
+ * to this function.
+ */
+static void nvimcom_glbnv_slice(void) {
+    tm = clock();
+    glbnslices++;
+    char *p = glbnvbuf2 + glboff;
+    double tmdiff = 0.0;
+    while (glbtop > 0 || glbidx < glbnnames) {
+        if (glbtop > 0)
+            p = nvimcom_glbnv_next_elmt(p);
+        else
+            p = nvimcom_glbnv_next_obj(p);
+        if (glbtop == 0 && nglbblk2 > 0)
+            glbblk2[nglbblk2 - 1].len =
+                (p - glbnvbuf2) - glbblk2[nglbblk2 - 1].start;
+        tmdiff = 1000 * ((double)clock() - tm) / CLOCKS_PER_SEC;
+        if (slicetime > 0 && tmdiff > slicetime)
+            break;
+    }
+    glboff = p - glbnvbuf2;
+    glbtime += tmdiff;
+
+    if (glbtop > 0 || glbidx < glbnnames)
+        return;
+
+    nvimcom_glbnv_reset();
+    nvimcom_glbnv_finish();
+}
+
+/**
+ * @brief Generate a list of objects in .GlobalEnv and store it in the
+ * glbnvbuf2 buffer. The string stored in glbnvbuf2 represents a file with the
+ * same format of the `omnils_` files in R.nvim's cache directory.
+ *
+ * This only starts the listing. A listing in progress is abandoned because
+ * the objects might have changed.
+ */
+static void nvimcom_globalenv_list(void) {
+    if (verbose > 4)
+        REprintf("nvimcom_globalenv_list()\n");
+
+    if (tmpdir[0] == 0)
+        return;
+
+    nvimcom_glbnv_reset();
+
+    memset(glbnvbuf2, 0, glbnvbufsize);
+    glboff = 0;
+    nglbblk2 = 0;
+    glbj = 0;
+    glbnreused = 0;
+    glbnslices = 0;
+    glbtime = 0.0;
+
+    glbnames = R_lsInternal(R_GlobalEnv, allnames);
+    R_PreserveObject(glbnames);
+    glbnnames = Rf_length(glbnames);
+    glbidx = 0;
+    glblisting = 1;
+
+    nvimcom_glbnv_slice();
+}
+
+/**
+ * @brief Register a path whose elements must be listed.
+ *
+ * The description of the top level object containing the path is discarded,
+ * so that it is rebuilt in the next listing.
+ *
+ * @param path Path of a list or S4 object (e.g. "alist$aS4obj@x").
+ * @return 1 if the path is new and 0 otherwise.
+ */
+static int nvimcom_expand(const char *path) {
+    for (int i = 0; i < nglbexp; i++)
+        if (strcmp(glbexp[i], path) == 0)
+            return 0;
+    glbexp = realloc(glbexp, (nglbexp + 1) * sizeof(char *));
+    glbexp[nglbexp] = strdup(path);
+    nglbexp++;
+    if (verbose > 3)
+        REprintf("nvimcom: expanding %s\n", path);
+
+    for (int k = 0; k < nglbblk1; k++) {
+        const char *o = glbnvbuf1 + glbblk1[k].start;
+        size_t nlen = strchr(o, '\006') - o;
+        if (strncmp(o, path, nlen) == 0 &&
+            (path[nlen] == 0 || path[nlen] == '$' || path[nlen] == '@' ||
+             path[nlen] == '['))
+            glbblk1[k].sig = 0;
+    }
+    return 1;
 }
 
 /**
@@ -871,7 +1253,9 @@ static Rboolean nvimcom_task(__attribute__((unused)) SEXP expr,
 #endif
     if (nrs_port[0] != 0) {
         nvimcom_checklibs();
-        if (autoglbenv)
+        // A listing in progress must restart because objects might have
+        // changed.
+        if (autoglbenv || glblisting)
             nvimcom_globalenv_list();
     }
     if (setwidth && getenv("COLUMNS")) {
@@ -908,12 +1292,47 @@ static void nvimcom_exec(__attribute__((unused)) void *nothing) {
         nvimcom_eval_expr(flag_eval);
         *flag_eval = 0;
     }
+    pthread_mutex_lock(&expand_lock);
+    char *paths = flag_expand;
+    flag_expand = NULL;
+    flag_expand_sz = 0;
+    pthread_mutex_unlock(&expand_lock);
+    if (paths) {
+        char *b = paths;
+        char *e;
+        while ((e = strchr(b, '\n'))) {
+            *e = 0;
+            if (nvimcom_expand(b))
+                flag_glbenv = 1;
+            b = e + 1;
+        }
+        free(paths);
+    }
     if (flag_glbenv) {
         nvimcom_globalenv_list();
         flag_glbenv = 0;
+    } else if (glblisting) {
+        nvimcom_glbnv_slice();
     }
 }
 
+/**
+ * @brief Put a single byte in a pipe to register that we have commands
+ * waiting to be executed. R will crash if we execute commands while it is
+ * busy with other tasks.
+ */
+static void nvimcom_fire(void) {
+    if (verbose > 4)
+        REprintf("nvimcom_fire()\n");
+    if (fired)
+        return;
+    fired = 1;
+    char buf[16];
+    *buf = 0;
+    if (write(ofd, buf, 1) <= 0)
+        REprintf("nvimcom error: write <= 0\n");
+}
+
 /**
  * @brief Check if there is anything in the pipe that we use to register that
  * there are commands to be evaluated. R only executes this function when it
@@ -932,24 +1351,11 @@ static void nvimcom_uih(__attribute__((unused)) void *data) {
         REprintf("nvimcom error: read < 1\n");
     R_ToplevelExec(nvimcom_exec, NULL);
     fired = 0;
+    // Resume the listing of .GlobalEnv the next time that R is idle
+    if (glblisting)
+        nvimcom_fire();
 }
 
-/**
- * @brief Put a single byte in a pipe to register that we have commands
- * waiting to be executed. R will crash if we execute commands while it is
- * busy with other tasks.
- */
-static void nvimcom_fire(void) {
-    if (verbose > 4)
-        REprintf("nvimcom_fire()\n");
-    if (fired)
-        return;
-    fired = 1;
-    char buf[16];
-    *buf = 0;
-    if (write(ofd, buf, 1) <= 0)
-        REprintf("nvimcom error: write <= 0\n");
-}
 #endif
 
 #ifdef WIN32
@@ -1005,6 +1411,16 @@ static void nvimcom_parse_received_msg(char *buf) {
     case 'N':
         autoglbenv = 0;
         break;
+    case 'F': // rnvimserver needs the complete list of objects
+        glbresync = 1;
+#ifdef WIN32
+        if (!r_is_busy)
+            nvimcom_globalenv_list();
+#else
+        flag_glbenv = 1;
+        nvimcom_fire();
+#endif
+        break;
     case 'G':
 #ifdef WIN32
         if (!r_is_busy)
@@ -1044,6 +1460,43 @@ static void nvimcom_parse_received_msg(char *buf) {
             snprintf(flag_eval, 510, "%s <- %s", p, p);
             flag_glbenv = 1;
             nvimcom_fire();
+#endif
+        }
+        break;
+    case 'X': // List the elements of lists or S4 objects (one path per line)
+        p = buf;
+        p++;
+        if (strstr(p, getenv("RNVIM_ID")) == p) {
+            p += strlen(getenv("RNVIM_ID"));
+#ifdef WIN32
+            int n = 0;
+            char *e;
+            while ((e = strchr(p, '\n'))) {
+                *e = 0;
+                n += nvimcom_expand(p);
+                p = e + 1;
+            }
+            if (n && !r_is_busy)
+                nvimcom_globalenv_list();
+#else
+            // rnvimserver requests each path only once. So, the paths are
+            // accumulated until R is idle, however many they are.
+            pthread_mutex_lock(&expand_lock);
+            size_t len = flag_expand ? strlen(flag_expand) : 0;
+            if (len + strlen(p) + 1 > flag_expand_sz) {
+                size_t sz = len + strlen(p) + 2048;
+                char *tmp = realloc(flag_expand, sz);
+                if (tmp) {
+                    if (!flag_expand)
+                        *tmp = 0;
+                    flag_expand = tmp;
+                    flag_expand_sz = sz;
+                }
+            }
+            if (len + strlen(p) + 1 <= flag_expand_sz)
+                strcat(flag_expand, p);
+            pthread_mutex_unlock(&expand_lock);
+            nvimcom_fire();
 #endif
         }
         break;
@@ -1085,32 +1538,59 @@ static DWORD WINAPI client_loop_thread(__attribute__((unused)) void *arg)
 static void *client_loop_thread(__attribute__((unused)) void *arg)
 #endif
 {
-    size_t len;
-    for (;;) {
-        char buff[1024];
-        memset(buff, '\0', sizeof(buff));
-        len = recv(sfd, buff, sizeof(buff), 0);
-#ifdef WIN32
-        if (len == 0 || buff[0] == 0 || buff[0] == EOF ||
-            strstr(buff, "QuitNow") == buff)
-#else
-        if (len == 0 || buff[0] == 0 || buff[0] == EOF)
-#endif
-        {
+    // rnvimserver ends each message with a NULL byte. A recv() may return
+    // several messages, or only part of one, which is kept in buf until the
+    // rest arrives.
+    char *buf = NULL;
+    size_t bsz = 0;  // Size of buf
+    size_t blen = 0; // Bytes in buf
+    int quit = 0;
+    while (!quit) {
+        if (bsz - blen < 1024) {
+            size_t sz = bsz ? 2 * bsz : 4096;
+            char *tmp = realloc(buf, sz);
+            if (!tmp) {
+                REprintf("client_loop_thread: out of memory\n");
+                break;
+            }
+            buf = tmp;
+            bsz = sz;
+        }
+        long len = recv(sfd, buf + blen, bsz - blen, 0);
+        if (len <= 0) {
             if (len == 0)
                 REprintf("Connection with rnvimserver was lost\n");
-            if (buff[0] == EOF)
-                REprintf("client_loop_thread: buff[0] == EOF\n");
+            break;
+        }
+        blen += len;
+
+        char *msg = buf;
+        char *end;
+        while ((end = memchr(msg, 0, buf + blen - msg))) {
 #ifdef WIN32
-            closesocket(sfd);
-            WSACleanup();
+            if (msg[0] == EOF || strstr(msg, "QuitNow") == msg) {
 #else
-            close(sfd);
+            if (msg[0] == EOF) {
 #endif
-            break;
+                if (msg[0] == EOF)
+                    REprintf("client_loop_thread: buff[0] == EOF\n");
+                quit = 1;
+                break;
+            }
+            if (msg[0])
+                nvimcom_parse_received_msg(msg);
+            msg = end + 1;
         }
-        nvimcom_parse_received_msg(buff);
+        blen -= msg - buf;
+        memmove(buf, msg, blen);
     }
+    free(buf);
+#ifdef WIN32
+    closesocket(sfd);
+    WSACleanup();
+#else
+    close(sfd);
+#endif
 #ifdef WIN32
     return 0;
 #else
@@ -1118,6 +1598,88 @@ static void *client_loop_thread(__attribute__((unused)) void *arg)
 #endif
 }
 
+/**
+ * @brief Connect to rnvimserver.
+ *
+ * If rnvimserver created a Unix domain socket (R and Neovim running on the
+ * same machine), connect to it. Otherwise, connect to its TCP port.
+ *
+ * @return The socket file descriptor or -1 in case of failure.
+ */
+#ifdef WIN32
+static SOCKET nvimcom_connect(void) {
+#else
+static int nvimcom_connect(void) {
+#endif
+#ifndef WIN32
+    if (nrs_sock[0]) {
+        struct sockaddr_un addr;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            REprintf("nvimcom: socket creation failed (%s)\n", nrs_sock);
+            return -1;
+        }
+        memset(&addr, '\0', sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, nrs_sock, sizeof(addr.sun_path) - 1);
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            REprintf("nvimcom: connection with the server failed (%s)\n",
+                     nrs_sock);
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+#endif
+
+    struct sockaddr_in servaddr;
+#ifdef WIN32
+    WSADATA d;
+    int wr = WSAStartup(MAKEWORD(2, 2), &d);
+    if (wr != 0) {
+        REprintf("WSAStartup failed: %d\n", wr);
+    }
+#endif
+    // socket create and verification
+#ifdef WIN32
+    SOCKET fd = socket(AF_INET, SOCK_STREAM, 0);
+#else
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+#endif
+    if (fd == -1) {
+        REprintf("nvimcom: socket creation failed (%d)\n", atoi(nrs_port));
+        return -1;
+    }
+    memset(&servaddr, '\0', sizeof(servaddr));
+
+    // assign IP, PORT
+    servaddr.sin_family = AF_INET;
+    if (getenv("NVIM_IP_ADDRESS"))
+        servaddr.sin_addr.s_addr = inet_addr(getenv("NVIM_IP_ADDRESS"));
+    else
+        servaddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    servaddr.sin_port = htons(atoi(nrs_port));
+
+    // connect the client socket to server socket
+    if (connect(fd, (struct sockaddr *)&servaddr, sizeof(servaddr)) != 0) {
+        REprintf("nvimcom: connection with the server failed (%s)\n",
+                 nrs_port);
+#ifdef WIN32
+        closesocket(fd);
+#else
+        close(fd);
+#endif
+        return -1;
+    }
+
+    // send_to_nvim() writes the header, the body and the final byte with
+    // separate calls. With Nagle's algorithm, the body would wait for the
+    // delayed ACK of the header, adding 40 ms to every message.
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+    return fd;
+}
+
 /**
  * @brief Set variables that will control nvimcom behavior and establish a TCP
  * connection with rnvimserver in a new thread. This function is called when
@@ -1134,16 +1696,25 @@ static void *client_loop_thread(__attribute__((unused)) void *arg)
  * @param age Should the list of objects in .GlobalEnv be automatically
  * updated? (`R_objbr_allnames` in init.vim)
  *
+ * @param slc Maximum time in milliseconds of each slice of work while listing
+ * the objects in .GlobalEnv (`nvimcom.slicetime` in ~/.Rprofile).
+ *
  * @param nvv nvimcom version
  *
  * @param rinfo Information on R to be passed to nvim.
  */
-void nvimcom_Start(int *vrb, int *anm, int *swd, int *age, char **nvv,
-                   char **rinfo) {
+void nvimcom_Start(int *vrb, int *anm, int *swd, int *age, int *slc,
+                   char **nvv, char **rinfo) {
     verbose = *vrb;
     allnames = *anm;
     setwidth = *swd;
     autoglbenv = *age;
+#ifdef WIN32
+    // R cannot resume the listing when idle on Windows
+    slicetime = 0;
+#else
+    slicetime = *slc < 0 ? 0 : *slc;
+#endif
 
     if (getenv("RNVIM_TMPDIR")) {
         strncpy(tmpdir, getenv("RNVIM_TMPDIR"), 500);
@@ -1162,6 +1733,14 @@ void nvimcom_Start(int *vrb, int *anm, int *swd, int *age, char **nvv,
 
     if (getenv("RNVIM_PORT"))
         strncpy(nrs_port, getenv("RNVIM_PORT"), 15);
+#ifndef WIN32
+    if (getenv("RNVIM_SOCKET")) {
+        strncpy(nrs_sock, getenv("RNVIM_SOCKET"), 107);
+        // nrs_port is also used as a flag indicating that the connection was
+        // requested.
+        strcpy(nrs_port, "unix");
+    }
+#endif
 
     if (verbose > 0)
         REprintf("nvimcom %s loaded\n", *nvv);
@@ -1170,6 +1749,10 @@ void nvimcom_Start(int *vrb, int *anm, int *swd, int *age, char **nvv,
             REprintf("  NVIM_IP_ADDRESS: %s\n", getenv("NVIM_IP_ADDRESS"));
         }
         REprintf("  RNVIM_PORT: %s\n", nrs_port);
+#ifndef WIN32
+        if (nrs_sock[0])
+            REprintf("  RNVIM_SOCKET: %s\n", nrs_sock);
+#endif
         REprintf("  RNVIM_ID: %s\n", getenv("RNVIM_ID"));
         REprintf("  RNVIM_TMPDIR: %s\n", tmpdir);
         REprintf("  RNVIM_COMPLDIR: %s\n", getenv("RNVIM_COMPLDIR"));
@@ -1198,47 +1781,19 @@ void nvimcom_Start(int *vrb, int *anm, int *swd, int *age, char **nvv,
 
     static int failure = 0;
 
-    if (atoi(nrs_port) > 0) {
-        struct sockaddr_in servaddr;
-#ifdef WIN32
-        WSADATA d;
-        int wr = WSAStartup(MAKEWORD(2, 2), &d);
-        if (wr != 0) {
-            REprintf("WSAStartup failed: %d\n", wr);
-        }
-#endif
-        // socket create and verification
-        sfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (atoi(nrs_port) > 0 || nrs_port[0] == 'u') {
+        sfd = nvimcom_connect();
         if (sfd != -1) {
-            memset(&servaddr, '\0', sizeof(servaddr));
-
-            // assign IP, PORT
-            servaddr.sin_family = AF_INET;
-            if (getenv("NVIM_IP_ADDRESS"))
-                servaddr.sin_addr.s_addr = inet_addr(getenv("NVIM_IP_ADDRESS"));
-            else
-                servaddr.sin_addr.s_addr = inet_addr("127.0.0.1");
-            servaddr.sin_port = htons(atoi(nrs_port));
-
-            // connect the client socket to server socket
-            if (connect(sfd, (struct sockaddr *)&servaddr, sizeof(servaddr)) ==
-                0) {
 #ifdef WIN32
-                DWORD ti;
-                tid = CreateThread(NULL, 0, client_loop_thread, NULL, 0, &ti);
-                nvimcom_send_running_info(*rinfo, *nvv);
+            DWORD ti;
+            tid = CreateThread(NULL, 0, client_loop_thread, NULL, 0, &ti);
+            nvimcom_send_running_info(*rinfo, *nvv);
 #else
-                pthread_create(&tid, NULL, client_loop_thread, NULL);
-                snprintf(flag_eval, 510, "nvimcom:::send_nvimcom_info('%d')", getpid());
-                nvimcom_fire();
+            pthread_create(&tid, NULL, client_loop_thread, NULL);
+            snprintf(flag_eval, 510, "nvimcom:::send_nvimcom_info('%d')", getpid());
+            nvimcom_fire();
 #endif
-            } else {
-                REprintf("nvimcom: connection with the server failed (%s)\n",
-                         nrs_port);
-                failure = 1;
-            }
         } else {
-            REprintf("nvimcom: socket creation failed (%d)\n", atoi(nrs_port));
             failure = 1;
         }
     }
@@ -1279,6 +1834,9 @@ void nvimcom_Stop(void) {
         close(sfd);
         pthread_cancel(tid);
         pthread_join(tid, NULL);
+        free(flag_expand);
+        flag_expand = NULL;
+        flag_expand_sz = 0;
 #endif
 
         LibInfo *lib = libList;
@@ -1294,8 +1852,22 @@ void nvimcom_Stop(void) {
             free(glbnvbuf1);
         if (glbnvbuf2)
             free(glbnvbuf2);
+        nvimcom_glbnv_reset();
+        for (int i = 0; i < nglbexp; i++)
+            free(glbexp[i]);
+        free(glbexp);
+        glbexp = NULL;
+        nglbexp = 0;
         if (send_ge_buf)
             free(send_ge_buf);
+        free(glbblk1);
+        free(glbblk2);
+        glbblk1 = NULL;
+        glbblk2 = NULL;
+        glbblksize = 0;
+        nglbblk1 = 0;
+        nglbblk2 = 0;
+        glbresync = 1;
         if (verbose)
             REprintf("nvimcom stopped\n");
     }